@@ -0,0 +1,242 @@
+/*
+  SPDX-FileCopyrightText: 2026 KDE PIM developers <kde-pim@kde.org>
+
+  SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "conflictresolverbenchmark.h"
+#include "conflictresolver.h"
+
+#include <KCalendarCore/FreeBusy>
+
+#include <QFile>
+#include <QRandomGenerator>
+#include <QTest>
+#include <QTimeZone>
+
+using namespace IncidenceEditorNG;
+
+namespace
+{
+// Data rows with more busy periods than this are skipped, they would take
+// minutes to generate and several hundred MB for the periods alone.
+const qint64 MAX_PERIODS = 1000000;
+
+// Reads a field like VmHWM (peak resident set size) from /proc/self/status, in KiB
+qint64 procStatusKiB(const QByteArray &field)
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> lines = status.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        if (line.startsWith(field + ':')) {
+            return line.mid(field.size() + 1).trimmed().split(' ').constFirst().toLongLong();
+        }
+    }
+    return -1;
+}
+
+// Resets the peak resident set size to the current one, so every data row reports its own peak
+void resetPeakMemory()
+{
+    QFile clearRefs(QStringLiteral("/proc/self/clear_refs"));
+    if (clearRefs.open(QIODevice::WriteOnly)) {
+        clearRefs.write("5");
+    }
+}
+}
+
+void ConflictResolverBenchmark::initTestCase()
+{
+    qputenv("TZ", "UTC");
+}
+
+void ConflictResolverBenchmark::init()
+{
+    mResolver = new ConflictResolver(nullptr, this);
+}
+
+void ConflictResolverBenchmark::cleanup()
+{
+    reportPeakMemory();
+    delete mResolver;
+    mResolver = nullptr;
+    mAttendees.clear();
+}
+
+void ConflictResolverBenchmark::createData()
+{
+    QTest::addColumn<int>("attendees");
+    QTest::addColumn<int>("days");
+    QTest::addColumn<int>("resolution");
+    QTest::addColumn<int>("eventsPerDay");
+
+    const QList<int> attendeeCounts = {10, 100, 1000};
+    const QList<int> dayCounts = {1, 7, 30, 365};
+    const QList<int> resolutions = {60, 15 * 60, 60 * 60};
+    const QList<std::pair<const char *, int>> densities = {{"sparse", 1}, {"dense", 8}};
+    for (int attendees : attendeeCounts) {
+        for (int days : dayCounts) {
+            for (int resolution : resolutions) {
+                for (const auto &density : densities) {
+                    if (qint64(attendees) * days * density.second > MAX_PERIODS) {
+                        continue;
+                    }
+                    QTest::addRow("%d attendees, %d days, %d s, %s", attendees, days, resolution, density.first)
+                        << attendees << days << resolution << density.second;
+                }
+            }
+        }
+    }
+}
+
+void ConflictResolverBenchmark::setupResolver()
+{
+    QFETCH(int, attendees);
+    QFETCH(int, days);
+    QFETCH(int, resolution);
+    QFETCH(int, eventsPerDay);
+
+    // findFreeSlot() never suggests a slot in the past, so the calendars start tomorrow
+    mBegin = QDateTime(QDate::currentDate().addDays(1), QTime(0, 0), QTimeZone::UTC);
+    mEnd = mBegin.addDays(days);
+
+    // The same seed per attendee creates the same calendars on every run.
+    // The meetings are spread over the office hours, so the dense calendars
+    // leave hardly any slot free for everybody.
+    for (int i = 0; i < attendees; ++i) {
+        QRandomGenerator random(i + 1);
+        KCalendarCore::Period::List busyPeriods;
+        busyPeriods.reserve(days * eventsPerDay);
+        for (int day = 0; day < days; ++day) {
+            const QDateTime officeHours = mBegin.addDays(day).addSecs(8 * 60 * 60);
+            for (int event = 0; event < eventsPerDay; ++event) {
+                const QDateTime start = officeHours.addSecs(random.bounded(10 * 60) * 60);
+                busyPeriods << KCalendarCore::Period(start, start.addSecs(15 * 60 * (1 + random.bounded(8))));
+            }
+        }
+        const auto role = i % 4 == 3 ? KCalendarCore::Attendee::OptParticipant : KCalendarCore::Attendee::ReqParticipant;
+        const KCalendarCore::Attendee attendee(QStringLiteral("attendee %1").arg(i),
+                                               QStringLiteral("attendee%1@example.org").arg(i),
+                                               false,
+                                               KCalendarCore::Attendee::Accepted,
+                                               role);
+        CalendarSupport::FreeBusyItem::Ptr item(new CalendarSupport::FreeBusyItem(attendee, nullptr));
+        item->setFreeBusy(KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busyPeriods)));
+        mAttendees << item;
+    }
+
+    resetPeakMemory();
+    for (const CalendarSupport::FreeBusyItem::Ptr &item : std::as_const(mAttendees)) {
+        mResolver->insertAttendee(item);
+    }
+    mResolver->setResolution(resolution);
+    mResolver->setEarliestDateTime(mBegin);
+    mResolver->setLatestDateTime(mEnd);
+}
+
+void ConflictResolverBenchmark::reportPeakMemory()
+{
+    const qint64 peak = procStatusKiB("VmHWM");
+    if (peak >= 0) {
+        qInfo("%s: peak memory %lld KiB", QTest::currentDataTag(), peak);
+    }
+}
+
+void ConflictResolverBenchmark::benchmarkFindAllFreeSlots_data()
+{
+    createData();
+}
+
+void ConflictResolverBenchmark::benchmarkFindAllFreeSlots()
+{
+    setupResolver();
+    QBENCHMARK {
+        mResolver->findAllFreeSlots();
+    }
+}
+
+void ConflictResolverBenchmark::benchmarkFindFreeSlot_data()
+{
+    createData();
+}
+
+void ConflictResolverBenchmark::benchmarkFindFreeSlot()
+{
+    setupResolver();
+    // a one hour meeting in the office hours of the first day, usually taken in the dense calendars
+    const KCalendarCore::Period meeting(mBegin.addSecs(10 * 60 * 60), mBegin.addSecs(11 * 60 * 60));
+    QBENCHMARK {
+        const bool found = mResolver->findFreeSlot(meeting);
+        Q_UNUSED(found)
+    }
+}
+
+void ConflictResolverBenchmark::benchmarkFirstFreeSlot_data()
+{
+    createData();
+}
+
+void ConflictResolverBenchmark::benchmarkFirstFreeSlot()
+{
+    setupResolver();
+    QBENCHMARK {
+        const KCalendarCore::Period slot = mResolver->firstFreeSlot(2 * 60 * 60);
+        Q_UNUSED(slot)
+    }
+}
+
+void ConflictResolverBenchmark::benchmarkFirstFreeSlotHalfYear_data()
+{
+    // firstFreeSlot() against the full free slot search it replaces,
+    // on half a year of dense calendars at a resolution of 5 minutes
+    QTest::addColumn<int>("attendees");
+    QTest::addColumn<int>("days");
+    QTest::addColumn<int>("resolution");
+    QTest::addColumn<int>("eventsPerDay");
+    QTest::addColumn<bool>("firstOnly");
+    for (int attendees : {10, 100}) {
+        QTest::addRow("%d attendees, first free slot", attendees) << attendees << 183 << 5 * 60 << 8 << true;
+        QTest::addRow("%d attendees, all free slots", attendees) << attendees << 183 << 5 * 60 << 8 << false;
+    }
+}
+
+void ConflictResolverBenchmark::benchmarkFirstFreeSlotHalfYear()
+{
+    QFETCH(bool, firstOnly);
+    setupResolver();
+    // the slot is found in the first evening, the full search converts all periods of the half year
+    if (firstOnly) {
+        QBENCHMARK {
+            const KCalendarCore::Period slot = mResolver->firstFreeSlot(2 * 60 * 60);
+            Q_UNUSED(slot)
+        }
+    } else {
+        QBENCHMARK {
+            mResolver->findAllFreeSlots();
+        }
+    }
+}
+
+void ConflictResolverBenchmark::benchmarkCalculateConflicts_data()
+{
+    createData();
+}
+
+void ConflictResolverBenchmark::benchmarkCalculateConflicts()
+{
+    setupResolver();
+    // every change of the timeframe checks all attendees for conflicts again
+    const QDateTime later = mBegin.addSecs(60 * 60);
+    bool toggle = false;
+    QBENCHMARK {
+        mResolver->setEarliestDateTime(toggle ? mBegin : later);
+        toggle = !toggle;
+    }
+}
+
+QTEST_MAIN(ConflictResolverBenchmark)
+
+#include "moc_conflictresolverbenchmark.cpp"
@@ -0,0 +1,54 @@
+/*
+  SPDX-FileCopyrightText: 2026 KDE PIM developers <kde-pim@kde.org>
+
+  SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <CalendarSupport/FreeBusyItem>
+
+#include <QDateTime>
+#include <QObject>
+
+namespace IncidenceEditorNG
+{
+class ConflictResolver;
+}
+
+/**
+ * Measures the ConflictResolver on synthetic free/busy data.
+ *
+ * Not run by ctest, run it with e.g. -tickcounter or -callgrind to compare
+ * changes of the scheduler. Besides the time, the peak memory of each data
+ * row is logged.
+ */
+class ConflictResolverBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void benchmarkFindAllFreeSlots_data();
+    void benchmarkFindAllFreeSlots();
+    void benchmarkFindFreeSlot_data();
+    void benchmarkFindFreeSlot();
+    void benchmarkFirstFreeSlot_data();
+    void benchmarkFirstFreeSlot();
+    void benchmarkFirstFreeSlotHalfYear_data();
+    void benchmarkFirstFreeSlotHalfYear();
+    void benchmarkCalculateConflicts_data();
+    void benchmarkCalculateConflicts();
+
+private:
+    void createData();
+    void setupResolver();
+    void reportPeakMemory();
+
+    QList<CalendarSupport::FreeBusyItem::Ptr> mAttendees;
+    IncidenceEditorNG::ConflictResolver *mResolver = nullptr;
+    QDateTime mBegin;
+    QDateTime mEnd;
+};
@@ -7,11 +7,19 @@
 
 #include "conflictresolvertest.h"
 #include "conflictresolver.h"
+#include "freebusycache.h"
+#include "incidenceeditorsettings.h"
+#include <CalendarSupport/FreeBusyItemModel>
 
 #include <KCalendarCore/Duration>
 #include <KCalendarCore/Event>
 #include <KCalendarCore/Period>
+#include <KCalendarCore/Recurrence>
 
+#include <QFileInfo>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTemporaryDir>
 #include <QTest>
 #include <QWidget>
 
@@ -35,6 +43,7 @@ void ConflictResolverTest::addAttendee(const QString &email, const KCalendarCore
 
 void ConflictResolverTest::initTestCase()
 {
+    QStandardPaths::setTestModeEnabled(true);
     parent = new QWidget;
     init();
 }
@@ -284,6 +293,883 @@ void ConflictResolverTest::testPeriodEndsAtSametimeAsTimeframe()
     QCOMPARE(resolver->availableSlots().size(), 0);
 }
 
+void ConflictResolverTest::testIntervalSweepEngine()
+{
+    KCalendarCore::Period meeting1(base.addSecs(7 * 60), KCalendarCore::Duration(2 * 60 * 60));
+    KCalendarCore::Period meeting2(base.addSecs(60 * 60), KCalendarCore::Duration(2 * 60 * 60 + 13 * 60));
+    KCalendarCore::Period meeting3(end.addSecs(-3 * 60 * 60), KCalendarCore::Duration(2 * 60 * 60));
+    addAttendee(QStringLiteral("john.f@kennedy.com"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting3 << meeting1)));
+    addAttendee(QStringLiteral("elvis@rock.com"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting2 << meeting3)));
+
+    insertAttendees();
+
+    resolver->setFreeSlotEngine(ConflictResolver::IntervalSweepEngine);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    resolver->findAllFreeSlots();
+
+    // the free slots are exact, they are not rounded to the slot resolution
+    QCOMPARE(resolver->availableSlots().size(), 3);
+    QCOMPARE(resolver->availableSlots().at(0).start(), base);
+    QCOMPARE(resolver->availableSlots().at(0).end(), meeting1.start());
+    QCOMPARE(resolver->availableSlots().at(1).start(), meeting2.end());
+    QCOMPARE(resolver->availableSlots().at(1).end(), meeting3.start());
+    QCOMPARE(resolver->availableSlots().at(2).start(), meeting3.end());
+    QCOMPARE(resolver->availableSlots().at(2).end(), end);
+}
+
+void ConflictResolverTest::testIntervalSweepEngineWeekdays()
+{
+    // 2010-07-29 is a Thursday
+    base = QDateTime(QDate(2010, 7, 29), QTime(12, 0));
+    end = QDateTime(QDate(2010, 8, 2), QTime(12, 0));
+    KCalendarCore::Period meeting(QDateTime(QDate(2010, 7, 29), QTime(14, 0)), QDateTime(QDate(2010, 7, 29), QTime(15, 0)));
+    addAttendee(QStringLiteral("kdabtest1@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting)));
+
+    insertAttendees();
+
+    QBitArray weekdays(7);
+    weekdays.setBit(0); // Monday
+    weekdays.setBit(3); // Thursday
+    resolver->setFreeSlotEngine(ConflictResolver::IntervalSweepEngine);
+    resolver->setAllowedWeekdays(weekdays);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    resolver->findAllFreeSlots();
+
+    QCOMPARE(resolver->availableSlots().size(), 3);
+    QCOMPARE(resolver->availableSlots().at(0), KCalendarCore::Period(base, meeting.start()));
+    QCOMPARE(resolver->availableSlots().at(1), KCalendarCore::Period(meeting.end(), QDateTime(QDate(2010, 7, 30), QTime(0, 0))));
+    QCOMPARE(resolver->availableSlots().at(2), KCalendarCore::Period(QDateTime(QDate(2010, 8, 2), QTime(0, 0)), end));
+}
+
+void ConflictResolverTest::testIncrementalFreeBusyUpdate()
+{
+    KCalendarCore::Period meeting(base.addSecs(2 * 60 * 60), KCalendarCore::Duration(2 * 60 * 60));
+    addAttendee(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting)));
+    addAttendee(QStringLiteral("elvis@rock.com"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List())));
+
+    insertAttendees();
+
+    QSignalSpy spy(resolver, &ConflictResolver::conflictsDetected);
+    resolver->setEarliestDateTime(meeting.start());
+    resolver->setLatestDateTime(meeting.end());
+    QCOMPARE(spy.last().at(0).toInt(), 1);
+
+    // the second attendee's free/busy arrives later on, only that row is recomputed
+    KCalendarCore::Period lateMeeting(meeting.start().addSecs(60 * 60), KCalendarCore::Duration(2 * 60 * 60));
+    resolver->model()->slotInsertFreeBusy(KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << lateMeeting)),
+                                          QStringLiteral("elvis@rock.com"));
+    QCOMPARE(spy.last().at(0).toInt(), 2);
+
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    resolver->findAllFreeSlots();
+    QCOMPARE(resolver->availableSlots().size(), 2);
+    QCOMPARE(resolver->availableSlots().at(0).end(), meeting.start());
+    QCOMPARE(resolver->availableSlots().at(1).start(), lateMeeting.end());
+
+    // removing the attendee subtracts its row again
+    resolver->removeAttendee(attendees.at(1)->attendee());
+    resolver->findAllFreeSlots();
+    QCOMPARE(resolver->availableSlots().size(), 2);
+    QCOMPARE(resolver->availableSlots().at(1).start(), meeting.end());
+}
+
+void ConflictResolverTest::testFirstFreeBusyPeriods()
+{
+    // an attendee without any free/busy periods yet
+    const KCalendarCore::Attendee elvis(QStringLiteral("attendee 0"), QStringLiteral("elvis@rock.com"));
+    resolver->insertAttendee(CalendarSupport::FreeBusyItem::Ptr(new CalendarSupport::FreeBusyItem(elvis, nullptr)));
+
+    QSignalSpy spy(resolver, &ConflictResolver::conflictsDetected);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    QCOMPARE(spy.last().at(0).toInt(), 0);
+
+    // the first periods arrive, the row of the attendee is rebuilt
+    const KCalendarCore::Period meeting(base.addSecs(60 * 60), KCalendarCore::Duration(60 * 60));
+    resolver->model()->slotInsertFreeBusy(KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting)), elvis.email());
+    QCOMPARE(spy.last().at(0).toInt(), 1);
+    QVERIFY(resolver->isBusy(0, meeting.start(), meeting.end()));
+}
+
+void ConflictResolverTest::testAsyncFreeSlotSearch()
+{
+    KCalendarCore::Period meeting(base.addSecs(2 * 60 * 60), KCalendarCore::Duration(2 * 60 * 60));
+    addAttendee(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting)));
+
+    insertAttendees();
+
+    QSignalSpy spy(resolver, &ConflictResolver::freeSlotsAvailable);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    QVERIFY(spy.wait());
+
+    // a burst of changes only yields the result of the latest constraints
+    spy.clear();
+    resolver->setLatestDateTime(meeting.start().addSecs(60 * 60));
+    resolver->setEarliestDateTime(meeting.start().addSecs(60 * 60));
+    resolver->setEarliestDateTime(base.addSecs(60 * 60));
+    QVERIFY(spy.wait());
+    QTest::qWait(100);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(resolver->availableSlots().size(), 1);
+    QCOMPARE(resolver->availableSlots().at(0).start(), base.addSecs(60 * 60));
+    QCOMPARE(resolver->availableSlots().at(0).end(), meeting.start());
+
+    // switching the engine searches again, with the new engine
+    spy.clear();
+    resolver->setEarliestDateTime(base.addSecs(7 * 60));
+    QVERIFY(spy.wait());
+    QCOMPARE(resolver->availableSlots().at(0).end(), base.addSecs(112 * 60));
+    spy.clear();
+    resolver->setFreeSlotEngine(ConflictResolver::IntervalSweepEngine);
+    QVERIFY(spy.wait());
+    QCOMPARE(resolver->availableSlots().at(0).end(), meeting.start());
+
+    // a synchronous search replaces the scheduled one
+    spy.clear();
+    resolver->setResolution(5 * 60);
+    resolver->findAllFreeSlots();
+    QCOMPARE(spy.count(), 1);
+    QTest::qWait(100);
+    QCOMPARE(spy.count(), 1);
+}
+
+void ConflictResolverTest::testNextFreeSlot()
+{
+    const qint64 hour = 60 * 60;
+    addAttendee(QStringLiteral("albert@einstein.net"),
+                KCalendarCore::FreeBusy::Ptr(
+                    new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << KCalendarCore::Period(base, KCalendarCore::Duration(2 * hour)))));
+    addAttendee(QStringLiteral("elvis@rock.com"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(
+                    KCalendarCore::Period::List() << KCalendarCore::Period(base.addSecs(3 * hour), KCalendarCore::Duration(hour))
+                                                  << KCalendarCore::Period(base.addSecs(5 * hour / 2), KCalendarCore::Duration(hour / 2)))));
+    addAttendee(QStringLiteral("ringo@rock.com"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List()
+                                                                         << KCalendarCore::Period(base.addDays(2), KCalendarCore::Duration(3 * 24 * hour)))));
+    insertAttendees();
+
+    // the requested hour is free
+    const KCalendarCore::Period freeHour(base.addSecs(4 * hour), KCalendarCore::Duration(hour));
+    QCOMPARE(resolver->nextFreeSlot(freeHour).start(), freeHour.start());
+    QVERIFY(resolver->findFreeSlot(freeHour));
+
+    // blocked by the first attendee, then by both adjacent meetings of the second one
+    const KCalendarCore::Period blockedHour(base.addSecs(hour), KCalendarCore::Duration(hour));
+    const KCalendarCore::Period slot = resolver->nextFreeSlot(blockedHour);
+    QCOMPARE(slot.start(), base.addSecs(4 * hour));
+    QCOMPARE(slot.end(), base.addSecs(5 * hour));
+
+    // the third attendee is busy for three days
+    const KCalendarCore::Period longMeeting(base.addDays(2), KCalendarCore::Duration(hour));
+    QCOMPARE(resolver->nextFreeSlot(longMeeting).start(), base.addDays(2).addSecs(3 * 24 * hour));
+    resolver->setSearchHorizon(1);
+    QVERIFY(!resolver->nextFreeSlot(longMeeting).start().isValid());
+    QVERIFY(!resolver->findFreeSlot(longMeeting));
+}
+
+void ConflictResolverTest::testWorkingHours_data()
+{
+    QTest::addColumn<ConflictResolver::FreeSlotEngine>("engine");
+    QTest::newRow("grid") << ConflictResolver::SlotGridEngine;
+    QTest::newRow("sweep") << ConflictResolver::IntervalSweepEngine;
+}
+
+void ConflictResolverTest::testWorkingHours()
+{
+    QFETCH(ConflictResolver::FreeSlotEngine, engine);
+
+    // 2010-07-29 is a Thursday
+    base = QDateTime(QDate(2010, 7, 29), QTime(0, 0));
+    end = QDateTime(QDate(2010, 8, 2), QTime(0, 0));
+    KCalendarCore::Period meeting(QDateTime(QDate(2010, 7, 29), QTime(10, 0)), QDateTime(QDate(2010, 7, 29), QTime(11, 0)));
+    addAttendee(QStringLiteral("kdabtest1@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting)));
+
+    insertAttendees();
+
+    QBitArray weekdays(7, true);
+    weekdays.clearBit(5); // Saturday
+    weekdays.clearBit(6); // Sunday
+    resolver->setFreeSlotEngine(engine);
+    resolver->setAllowedWeekdays(weekdays);
+    resolver->setWorkingHours(QTime(9, 0), QTime(17, 0));
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    resolver->findAllFreeSlots();
+
+    QCOMPARE(resolver->availableSlots().size(), 3);
+    QCOMPARE(resolver->availableSlots().at(0), KCalendarCore::Period(QDateTime(QDate(2010, 7, 29), QTime(9, 0)), meeting.start()));
+    QCOMPARE(resolver->availableSlots().at(1), KCalendarCore::Period(meeting.end(), QDateTime(QDate(2010, 7, 29), QTime(17, 0))));
+    QCOMPARE(resolver->availableSlots().at(2),
+             KCalendarCore::Period(QDateTime(QDate(2010, 7, 30), QTime(9, 0)), QDateTime(QDate(2010, 7, 30), QTime(17, 0))));
+
+    resolver->clearWorkingHours();
+    resolver->findAllFreeSlots();
+    QCOMPARE(resolver->availableSlots().size(), 2);
+}
+
+void ConflictResolverTest::testRankedSlots()
+{
+    base = QDateTime(QDate(2010, 7, 29), QTime(9, 0));
+    end = QDateTime(QDate(2010, 7, 29), QTime(13, 0));
+    addAttendee(QStringLiteral("required1@demo.kolab.org"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << KCalendarCore::Period(_time(9, 0), _time(11, 0)))));
+    addAttendee(QStringLiteral("required2@demo.kolab.org"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << KCalendarCore::Period(_time(12, 0), _time(13, 0)))));
+    addAttendee(QStringLiteral("optional@demo.kolab.org"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << KCalendarCore::Period(_time(9, 0), _time(10, 0)))),
+                KCalendarCore::Attendee::OptParticipant);
+
+    insertAttendees();
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+
+    const QList<ConflictResolver::RankedSlot> slots = resolver->rankedSlots(60 * 60, 3);
+    QCOMPARE(slots.size(), 3);
+    QCOMPARE(slots.at(0).period, KCalendarCore::Period(_time(11, 0), _time(12, 0)));
+    QCOMPARE(slots.at(0).weightedConflicts, 0.0);
+    QCOMPARE(slots.at(1).period, KCalendarCore::Period(_time(10, 0), _time(11, 0)));
+    QCOMPARE(slots.at(1).weightedConflicts, 2.0);
+    QCOMPARE(slots.at(1).conflictingAttendees, 1);
+    QCOMPARE(slots.at(2).period, KCalendarCore::Period(_time(12, 0), _time(13, 0)));
+
+    // the optional attendee now weighs more than a required one
+    resolver->setRoleWeight(KCalendarCore::Attendee::OptParticipant, 3);
+    resolver->setRoleWeight(KCalendarCore::Attendee::ReqParticipant, 1);
+    const QList<ConflictResolver::RankedSlot> reweighted = resolver->rankedSlots(2 * 60 * 60, 1);
+    QCOMPARE(reweighted.size(), 1);
+    QCOMPARE(reweighted.at(0).period, KCalendarCore::Period(_time(10, 0), _time(12, 0)));
+    QCOMPARE(reweighted.at(0).weightedConflicts, 1.0);
+}
+
+void ConflictResolverTest::testConstraintsUpdate()
+{
+    KCalendarCore::Period meeting(base.addSecs(2 * 60 * 60), KCalendarCore::Duration(2 * 60 * 60));
+    addAttendee(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting)));
+
+    insertAttendees();
+
+    QSignalSpy spy(resolver, &ConflictResolver::conflictsDetected);
+    resolver->beginConstraintsUpdate();
+    resolver->setEarliestDateTime(base);
+    resolver->beginConstraintsUpdate();
+    resolver->setLatestDateTime(end);
+    resolver->setAllowedWeekdays(QBitArray(7, true));
+    resolver->endConstraintsUpdate();
+    QCOMPARE(spy.count(), 0);
+    resolver->endConstraintsUpdate();
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.last().at(0).toInt(), 1);
+
+    // without changes, there is nothing to recompute
+    resolver->beginConstraintsUpdate();
+    resolver->endConstraintsUpdate();
+    QCOMPARE(spy.count(), 1);
+
+    // the searches see the new timeframe right away, only the conflicts wait for the end
+    resolver->beginConstraintsUpdate();
+    resolver->setEarliestDateTime(meeting.end());
+    QCOMPARE(resolver->firstFreeSlot(60 * 60), KCalendarCore::Period(meeting.end(), meeting.end().addSecs(60 * 60)));
+    QCOMPARE(spy.count(), 1);
+    resolver->endConstraintsUpdate();
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(spy.last().at(0).toInt(), 0);
+}
+
+void ConflictResolverTest::testRecurringFreeSlots()
+{
+    // 2010-08-02 is a Monday
+    base = QDateTime(QDate(2010, 8, 2), QTime(9, 0));
+    end = QDateTime(QDate(2010, 8, 2), QTime(12, 0));
+    const KCalendarCore::Period secondWeek(QDateTime(QDate(2010, 8, 9), QTime(9, 0)), QDateTime(QDate(2010, 8, 9), QTime(10, 0)));
+    const KCalendarCore::Period thirdWeek(QDateTime(QDate(2010, 8, 16), QTime(10, 0)), QDateTime(QDate(2010, 8, 16), QTime(11, 0)));
+    addAttendee(QStringLiteral("kdabtest1@demo.kolab.org"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << secondWeek << thirdWeek)));
+
+    insertAttendees();
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+
+    KCalendarCore::Recurrence recurrence;
+    recurrence.setStartDateTime(base, false);
+    recurrence.setWeekly(1);
+
+    // free in all four weeks only from 11:00
+    KCalendarCore::Period::List slots = resolver->recurringFreeSlots(recurrence, 60 * 60, 4);
+    QCOMPARE(slots.size(), 1);
+    QCOMPARE(slots.at(0), KCalendarCore::Period(_time(11, 0), _time(12, 0)));
+
+    // a conflict in one of the four weeks is accepted
+    slots = resolver->recurringFreeSlots(recurrence, 60 * 60, 4, 0.75);
+    QCOMPARE(slots.size(), 2);
+    QCOMPARE(slots.at(0), KCalendarCore::Period(_time(9, 0), _time(10, 0)));
+    QCOMPARE(slots.at(1), KCalendarCore::Period(_time(10, 0), _time(12, 0)));
+
+    // the third week is not looked at
+    slots = resolver->recurringFreeSlots(recurrence, 60 * 60, 2);
+    QCOMPARE(slots.size(), 1);
+    QCOMPARE(slots.at(0), KCalendarCore::Period(_time(10, 0), _time(12, 0)));
+}
+
+void ConflictResolverTest::testSecondResolutionLongTimeframe()
+{
+    // more one second slots than fit into an int
+    end = base.addYears(100);
+    const KCalendarCore::Period meeting(base.addYears(90), base.addYears(90).addSecs(7));
+    addAttendee(QStringLiteral("kdabtest1@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting)));
+
+    insertAttendees();
+    resolver->setResolution(1);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    resolver->findAllFreeSlots();
+
+    QCOMPARE(resolver->availableSlots().size(), 2);
+    QCOMPARE(resolver->availableSlots().at(0), KCalendarCore::Period(base, meeting.start()));
+    QCOMPARE(resolver->availableSlots().at(1), KCalendarCore::Period(meeting.end(), end));
+}
+
+void ConflictResolverTest::testFirstFreeSlot()
+{
+    // busy during the working hours of half a year, except for two hours on one day
+    base = QDateTime(QDate(2010, 7, 29), QTime(0, 0));
+    end = base.addMonths(6);
+    const QDate freeDay = base.date().addDays(100);
+    KCalendarCore::Period::List busy;
+    for (QDate date = base.date(); date < end.date(); date = date.addDays(1)) {
+        if (date == freeDay) {
+            busy << KCalendarCore::Period(QDateTime(date, QTime(9, 0)), QDateTime(date, QTime(11, 0)));
+            busy << KCalendarCore::Period(QDateTime(date, QTime(13, 0)), QDateTime(date, QTime(18, 0)));
+        } else {
+            busy << KCalendarCore::Period(QDateTime(date, QTime(9, 0)), QDateTime(date, QTime(18, 0)));
+        }
+    }
+    addAttendee(QStringLiteral("kdabtest1@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+
+    insertAttendees();
+    resolver->setResolution(5 * 60);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+
+    // the evenings are free
+    QCOMPARE(resolver->firstFreeSlot(2 * 60 * 60), KCalendarCore::Period(QDateTime(base.date(), QTime(18, 0)), QDateTime(base.date(), QTime(20, 0))));
+    // the nights span two chunks of the search
+    QCOMPARE(resolver->firstFreeSlot(15 * 60 * 60),
+             KCalendarCore::Period(QDateTime(base.date(), QTime(18, 0)), QDateTime(base.date().addDays(1), QTime(9, 0))));
+
+    resolver->setWorkingHours(QTime(9, 0), QTime(18, 0));
+    QCOMPARE(resolver->firstFreeSlot(2 * 60 * 60), KCalendarCore::Period(QDateTime(freeDay, QTime(11, 0)), QDateTime(freeDay, QTime(13, 0))));
+    QCOMPARE(resolver->firstFreeSlot(60 * 60), KCalendarCore::Period(QDateTime(freeDay, QTime(11, 0)), QDateTime(freeDay, QTime(12, 0))));
+    QVERIFY(!resolver->firstFreeSlot(2 * 60 * 60 + 1).start().isValid());
+}
+
+void ConflictResolverTest::testUnalignedBusyPeriod()
+{
+    // busy from 09:10 to 09:40, the slots of the grid are 15 minutes
+    base = QDateTime(QDate(2010, 7, 29), QTime(9, 0));
+    end = base.addSecs(4 * 60 * 60);
+    const KCalendarCore::Period meeting(base.addSecs(10 * 60), base.addSecs(40 * 60));
+    addAttendee(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << meeting)));
+
+    insertAttendees();
+    resolver->setResolution(15 * 60);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+
+    // the slot the period ends in isn't free
+    const KCalendarCore::Period slot = resolver->firstFreeSlot(60 * 60);
+    QCOMPARE(slot, KCalendarCore::Period(base.addSecs(45 * 60), base.addSecs(105 * 60)));
+    QVERIFY(slot.start() >= meeting.end());
+
+    resolver->findAllFreeSlots();
+    QCOMPARE(resolver->availableSlots().size(), 1);
+    QCOMPARE(resolver->availableSlots().at(0).start(), base.addSecs(45 * 60));
+}
+
+void ConflictResolverTest::testProgressiveFreeSlots()
+{
+    // busy one hour out of four, for three days
+    end = base.addDays(3);
+    KCalendarCore::Period::List busy;
+    for (QDateTime start = base.addSecs(60 * 60); start < end; start = start.addSecs(4 * 60 * 60)) {
+        busy << KCalendarCore::Period(start, KCalendarCore::Duration(60 * 60));
+    }
+    addAttendee(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+
+    insertAttendees();
+    resolver->setProgressiveBatchSize(2);
+
+    QSignalSpy foundSpy(resolver, &ConflictResolver::freeSlotsFound);
+    QSignalSpy availableSpy(resolver, &ConflictResolver::freeSlotsAvailable);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    QVERIFY(availableSpy.wait());
+
+    // the earliest slots come first, then batches of growing size
+    QVERIFY(foundSpy.count() > 1);
+    QCOMPARE(foundSpy.at(0).at(0).value<KCalendarCore::Period::List>().size(), 2);
+    QCOMPARE(foundSpy.at(0).at(1).toBool(), true);
+    KCalendarCore::Period::List found;
+    for (int i = 0; i < foundSpy.count(); ++i) {
+        QCOMPARE(foundSpy.at(i).at(1).toBool(), i == 0);
+        found << foundSpy.at(i).at(0).value<KCalendarCore::Period::List>();
+    }
+    QCOMPARE(found, resolver->availableSlots());
+
+    // the same slots as the search without progressive results
+    resolver->setProgressiveBatchSize(0);
+    resolver->findAllFreeSlots();
+    QCOMPARE(found, resolver->availableSlots());
+    QCOMPARE(found.size(), busy.size() + 1);
+}
+
+void ConflictResolverTest::testConflictHistogram()
+{
+    base = QDateTime(QDate(2010, 7, 29), QTime(9, 0));
+    end = QDateTime(QDate(2010, 7, 29), QTime(13, 0));
+    addAttendee(QStringLiteral("required1@demo.kolab.org"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << KCalendarCore::Period(_time(9, 0), _time(11, 0)))));
+    addAttendee(QStringLiteral("required2@demo.kolab.org"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List() << KCalendarCore::Period(_time(10, 0), _time(12, 0)))));
+
+    insertAttendees();
+    QSignalSpy spy(resolver, &ConflictResolver::conflictHistogramChanged);
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+    resolver->findAllFreeSlots();
+    QVERIFY(spy.count() > 0);
+
+    const ConflictResolver::ConflictHistogram &histogram = resolver->conflictHistogram();
+    QCOMPARE(histogram.slots, qint64(16));
+    QCOMPARE(histogram.slotStart(4), _time(10, 0));
+    const QList<std::pair<qint64, int>> expected = {{0, 1}, {4, 2}, {8, 1}, {12, 0}};
+    QCOMPARE(histogram.runs.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(histogram.runs.at(i).first, expected.at(i).first);
+        QCOMPARE(histogram.runs.at(i).last, i + 1 < expected.size() ? expected.at(i + 1).first : histogram.slots);
+        QCOMPARE(histogram.runs.at(i).busyAttendees, expected.at(i).second);
+    }
+}
+
+void ConflictResolverTest::testStatusWeights()
+{
+    base = QDateTime(QDate(2010, 7, 29), QTime(9, 0));
+    end = QDateTime(QDate(2010, 7, 29), QTime(13, 0));
+    KCalendarCore::FreeBusyPeriod tentative(_time(9, 0), _time(10, 0));
+    tentative.setType(KCalendarCore::FreeBusyPeriod::BusyTentative);
+    KCalendarCore::FreeBusyPeriod busy(_time(10, 0), _time(11, 0));
+    busy.setType(KCalendarCore::FreeBusyPeriod::Busy);
+    addAttendee(QStringLiteral("required1@demo.kolab.org"),
+                KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::FreeBusyPeriod::List() << tentative << busy)));
+
+    insertAttendees();
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+
+    // the tentative period is a soft conflict
+    QList<ConflictResolver::RankedSlot> slots = resolver->rankedSlots(60 * 60, 4);
+    QCOMPARE(slots.size(), 4);
+    QCOMPARE(slots.at(0).period, KCalendarCore::Period(_time(11, 0), _time(12, 0)));
+    QCOMPARE(slots.at(1).period, KCalendarCore::Period(_time(12, 0), _time(13, 0)));
+    QCOMPARE(slots.at(2).period, KCalendarCore::Period(_time(9, 0), _time(10, 0)));
+    QCOMPARE(slots.at(2).weightedConflicts, 1.0);
+    QCOMPARE(slots.at(3).period, KCalendarCore::Period(_time(10, 0), _time(11, 0)));
+    QCOMPARE(slots.at(3).weightedConflicts, 2.0);
+    QCOMPARE(slots.at(3).conflictingAttendees, 1);
+
+    // overlapping both periods counts the attendee once, with the busier status
+    slots = resolver->rankedSlots(2 * 60 * 60, 1);
+    QCOMPARE(slots.size(), 1);
+    QCOMPARE(slots.at(0).period, KCalendarCore::Period(_time(11, 0), _time(13, 0)));
+    slots = resolver->rankedSlots(4 * 60 * 60, 1);
+    QCOMPARE(slots.size(), 1);
+    QCOMPARE(slots.at(0).weightedConflicts, 2.0);
+    QCOMPARE(slots.at(0).conflictingAttendees, 1);
+
+    resolver->setStatusWeight(KCalendarCore::FreeBusyPeriod::BusyTentative, 100);
+    slots = resolver->rankedSlots(60 * 60, 4);
+    QCOMPARE(slots.at(2).weightedConflicts, 2.0);
+}
+
+void ConflictResolverTest::testRoomSlots()
+{
+    KCalendarCore::Period::List busy;
+    busy << KCalendarCore::Period(base.addSecs(2 * 60 * 60), base.addSecs(4 * 60 * 60));
+    addAttendee(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    insertAttendees();
+
+    const auto room = [](const QString &email, const KCalendarCore::Period &busy) {
+        KCalendarCore::Attendee attendee(email, email);
+        attendee.setCuType(KCalendarCore::Attendee::Room);
+        CalendarSupport::FreeBusyItem::Ptr item(new CalendarSupport::FreeBusyItem(attendee, nullptr));
+        item->setFreeBusy(KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List{busy})));
+        return item;
+    };
+    resolver->insertRoom(room(QStringLiteral("room-a@demo.kolab.org"), KCalendarCore::Period(base, base.addSecs(60 * 60))));
+    resolver->insertRoom(room(QStringLiteral("room-b@demo.kolab.org"), KCalendarCore::Period(base.addSecs(6 * 60 * 60), end)));
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(end);
+
+    QList<ConflictResolver::RoomSlot> slots = resolver->freeSlotsWithRooms();
+    QCOMPARE(slots.size(), 4);
+    QCOMPARE(slots.at(0).period, KCalendarCore::Period(base, base.addSecs(2 * 60 * 60)));
+    QCOMPARE(slots.at(0).room.email(), QStringLiteral("room-b@demo.kolab.org"));
+    QCOMPARE(slots.at(1).period, KCalendarCore::Period(base.addSecs(60 * 60), base.addSecs(2 * 60 * 60)));
+    QCOMPARE(slots.at(1).room.email(), QStringLiteral("room-a@demo.kolab.org"));
+    QCOMPARE(slots.at(2).period, KCalendarCore::Period(base.addSecs(4 * 60 * 60), end));
+    QCOMPARE(slots.at(2).room.email(), QStringLiteral("room-a@demo.kolab.org"));
+    QCOMPARE(slots.at(3).period, KCalendarCore::Period(base.addSecs(4 * 60 * 60), base.addSecs(6 * 60 * 60)));
+    QCOMPARE(slots.at(3).room.email(), QStringLiteral("room-b@demo.kolab.org"));
+
+    // room a is too short before the meeting of the attendee
+    slots = resolver->freeSlotsWithRooms(90 * 60);
+    QCOMPARE(slots.size(), 3);
+    QCOMPARE(slots.at(0).room.email(), QStringLiteral("room-b@demo.kolab.org"));
+    QCOMPARE(slots.at(1).room.email(), QStringLiteral("room-a@demo.kolab.org"));
+    QCOMPARE(slots.at(2).room.email(), QStringLiteral("room-b@demo.kolab.org"));
+
+    // the rooms don't change the other searches
+    QCOMPARE(resolver->firstFreeSlot(2 * 60 * 60), KCalendarCore::Period(base, base.addSecs(2 * 60 * 60)));
+
+    resolver->clearRooms();
+    QVERIFY(resolver->freeSlotsWithRooms().isEmpty());
+}
+
+void ConflictResolverTest::testScheduleMeetings()
+{
+    base = QDateTime(QDate(2010, 7, 29), QTime(8, 0));
+    const auto hours = [](int count) {
+        return qint64(count) * 60 * 60;
+    };
+    KCalendarCore::Period::List busy;
+    busy << KCalendarCore::Period(base.addSecs(hours(1)), base.addSecs(hours(2)));
+    addAttendee(QStringLiteral("alice@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    addAttendee(QStringLiteral("bob@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List())));
+    addAttendee(QStringLiteral("carol@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List())));
+    insertAttendees();
+    const KCalendarCore::Attendee alice = attendees.at(0)->attendee();
+    const KCalendarCore::Attendee bob = attendees.at(1)->attendee();
+    const KCalendarCore::Attendee carol = attendees.at(2)->attendee();
+
+    // meetings sharing an attendee don't overlap
+    const KCalendarCore::Period window(base, base.addSecs(hours(4)));
+    QList<ConflictResolver::MeetingRequest> meetings;
+    meetings << ConflictResolver::MeetingRequest{{alice, bob}, hours(1), window};
+    meetings << ConflictResolver::MeetingRequest{{bob, carol}, hours(1), window};
+    meetings << ConflictResolver::MeetingRequest{{alice, carol}, hours(2), window};
+    KCalendarCore::Period::List periods = resolver->scheduleMeetings(meetings);
+    QCOMPARE(periods.size(), 3);
+    QCOMPARE(periods.at(0), KCalendarCore::Period(base, base.addSecs(hours(1))));
+    QCOMPARE(periods.at(1), KCalendarCore::Period(base.addSecs(hours(1)), base.addSecs(hours(2))));
+    QCOMPARE(periods.at(2), KCalendarCore::Period(base.addSecs(hours(2)), base.addSecs(hours(4))));
+
+    // the greedy slot of the first meeting leaves no room for the second one
+    meetings.clear();
+    meetings << ConflictResolver::MeetingRequest{{bob}, hours(1), KCalendarCore::Period(base, base.addSecs(hours(3)))};
+    meetings << ConflictResolver::MeetingRequest{{bob}, hours(2), KCalendarCore::Period(base, base.addSecs(hours(2)))};
+    periods = resolver->scheduleMeetings(meetings);
+    QCOMPARE(periods.at(0), KCalendarCore::Period(base, base.addSecs(hours(1))));
+    QVERIFY(!periods.at(1).start().isValid());
+
+    periods = resolver->scheduleMeetings(meetings, 1000);
+    QCOMPARE(periods.at(0), KCalendarCore::Period(base.addSecs(hours(2)), base.addSecs(hours(3))));
+    QCOMPARE(periods.at(1), KCalendarCore::Period(base, base.addSecs(hours(2))));
+
+    // the emails are matched in any case
+    KCalendarCore::Attendee shouting = alice;
+    shouting.setEmail(QStringLiteral("Alice@Demo.Kolab.org"));
+    meetings.clear();
+    meetings << ConflictResolver::MeetingRequest{{shouting}, hours(1), KCalendarCore::Period(base.addSecs(hours(1)), base.addSecs(hours(3)))};
+    meetings << ConflictResolver::MeetingRequest{{alice}, hours(1), KCalendarCore::Period(base.addSecs(hours(1)), base.addSecs(hours(3)))};
+    periods = resolver->scheduleMeetings(meetings);
+    QCOMPARE(periods.at(0), KCalendarCore::Period(base.addSecs(hours(2)), base.addSecs(hours(3))));
+    QVERIFY(!periods.at(1).start().isValid());
+}
+
+void ConflictResolverTest::testFreeBusyCache()
+{
+    const QString email = QStringLiteral("albert@einstein.net");
+    KCalendarCore::Period::List busy;
+    busy << KCalendarCore::Period(base, base.addSecs(60 * 60));
+    FreeBusyCache *cache = FreeBusyCache::self();
+    cache->insert(email, KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    QVERIFY(cache->lookup(QStringLiteral("Albert@Einstein.net")));
+
+    // the cached free/busy info is used right away, without a fetch
+    resolver->insertAttendee(KCalendarCore::Attendee(QStringLiteral("Albert"), email));
+    QVERIFY(!cache->isFetching(email));
+    const QModelIndex index = resolver->model()->index(0);
+    const auto freebusy = resolver->model()->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
+    QVERIFY(freebusy);
+    QCOMPARE(freebusy->busyPeriods().size(), 1);
+
+    cache->invalidate(email);
+    QVERIFY(!cache->lookup(email));
+
+    // the model of an item which failed to fetch may fetch it itself
+    QStringList fetched;
+    bool fetchStarts = false;
+    cache->setFetcher([&fetched, &fetchStarts](const QString &email, QWidget *) {
+        fetched << email;
+        return fetchStarts;
+    });
+    const KCalendarCore::Attendee elvis(QStringLiteral("Elvis"), QStringLiteral("elvis@rock.com"));
+    QVERIFY(!cache->createItem(elvis, nullptr)->isDownloading());
+
+    // an item whose free/busy info is being fetched or fresh doesn't fetch it a second time,
+    // the cache sets the fetched info on it
+    fetchStarts = true;
+    const CalendarSupport::FreeBusyItem::Ptr item = cache->createItem(elvis, nullptr);
+    QVERIFY(item->isDownloading());
+    const KCalendarCore::FreeBusy::Ptr elvisBusy(new KCalendarCore::FreeBusy(busy));
+    cache->insert(elvis.email(), elvisBusy);
+    QCOMPARE(item->freeBusy(), elvisBusy);
+    QVERIFY(!item->isDownloading());
+    QVERIFY(cache->createItem(elvis, nullptr)->isDownloading());
+    QCOMPARE(fetched.size(), 2);
+
+    // once the free/busy info expires, it is fetched again
+    cache->setTimeToLive(1);
+    QTRY_COMPARE(fetched.size(), 3);
+    QVERIFY(item->isDownloading());
+    cache->setTimeToLive(5 * 60);
+    cache->insert(elvis.email(), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    QVERIFY(!item->isDownloading());
+
+    // the info fetched for an email in another letter case reaches the item and its model
+    resolver->insertAttendee(KCalendarCore::Attendee(QStringLiteral("Bob"), QStringLiteral("Bob@Demo.Kolab.org")));
+    QCOMPARE(fetched.size(), 4);
+    const QModelIndex bobIndex = resolver->model()->index(resolver->model()->rowCount() - 1);
+    QVERIFY(!resolver->model()->data(bobIndex, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>());
+    const KCalendarCore::FreeBusy::Ptr bobBusy(new KCalendarCore::FreeBusy(busy));
+    cache->insert(QStringLiteral("bob@demo.kolab.org"), bobBusy);
+    QCOMPARE(resolver->model()->data(bobIndex, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>(), bobBusy);
+
+    cache->setFetcher({});
+    cache->clear();
+    QVERIFY(!item->isDownloading());
+}
+
+void ConflictResolverTest::testFreeBusySnapshot()
+{
+    const QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    IncidenceEditorSettings::self()->setFreeBusySnapshot(true);
+    FreeBusyCache *cache = FreeBusyCache::self();
+    cache->setSnapshotFile(dir.filePath(QStringLiteral("freebusy.snapshot")));
+
+    const QDateTime start(QDate(2010, 7, 29), QTime(8, 0), QTimeZone::utc());
+    KCalendarCore::Period::List busy;
+    busy << KCalendarCore::Period(start.addSecs(2 * 60 * 60), start.addSecs(3 * 60 * 60));
+    busy << KCalendarCore::Period(start, start.addSecs(60 * 60));
+    const QDateTime fetched = QDateTime::currentDateTime().addDays(-1);
+    cache->insert(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)), fetched);
+    cache->insert(QStringLiteral("kdabtest1@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List())));
+    // too old to be kept
+    cache->insert(QStringLiteral("elvis@rock.com"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)), QDateTime::currentDateTime().addDays(-30));
+    QVERIFY(cache->saveSnapshot());
+    // only the user can read the busy times of others
+    const QFileDevice::Permissions permissions = QFileInfo(cache->snapshotFile()).permissions();
+    QVERIFY(permissions & QFileDevice::ReadOwner);
+    QVERIFY(!(permissions & (QFileDevice::ReadGroup | QFileDevice::ReadOther)));
+
+    // a new process only has the snapshot, it is outdated but known
+    cache->clear();
+    cache->setSnapshotFile(dir.filePath(QStringLiteral("freebusy.snapshot")));
+    QVERIFY(!cache->lookup(QStringLiteral("albert@einstein.net")));
+    const KCalendarCore::FreeBusy::Ptr freebusy = cache->lastKnown(QStringLiteral("albert@einstein.net"));
+    QVERIFY(freebusy);
+    const KCalendarCore::Period::List periods = freebusy->busyPeriods();
+    QCOMPARE(periods.size(), 2);
+    QCOMPARE(periods.at(0).start(), start);
+    QCOMPARE(periods.at(0).end(), start.addSecs(60 * 60));
+    QCOMPARE(periods.at(1).start(), start.addSecs(2 * 60 * 60));
+    QVERIFY(cache->lastKnown(QStringLiteral("kdabtest1@demo.kolab.org")));
+    QVERIFY(!cache->lastKnown(QStringLiteral("elvis@rock.com")));
+
+    // saving again keeps the attendees of the snapshot
+    cache->insert(QStringLiteral("bob@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    cache->invalidate(QStringLiteral("kdabtest1@demo.kolab.org"));
+    QVERIFY(cache->saveSnapshot());
+    cache->clear();
+    cache->setSnapshotFile(dir.filePath(QStringLiteral("freebusy.snapshot")));
+    QVERIFY(cache->lastKnown(QStringLiteral("albert@einstein.net")));
+    QVERIFY(cache->lastKnown(QStringLiteral("bob@demo.kolab.org")));
+    QVERIFY(!cache->lastKnown(QStringLiteral("kdabtest1@demo.kolab.org")));
+
+    // another process rewrites the file in the meantime, its attendees are merged
+    const QString otherFile = dir.filePath(QStringLiteral("other.snapshot"));
+    cache->setSnapshotFile(otherFile);
+    cache->insert(QStringLiteral("carol@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    QVERIFY(cache->saveSnapshot());
+    cache->clear();
+    cache->setSnapshotFile(dir.filePath(QStringLiteral("freebusy.snapshot")));
+    QVERIFY(!cache->lastKnown(QStringLiteral("carol@demo.kolab.org")));
+    QVERIFY(QFile::remove(cache->snapshotFile()));
+    QVERIFY(QFile::copy(otherFile, cache->snapshotFile()));
+    cache->insert(QStringLiteral("dave@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    QVERIFY(cache->saveSnapshot());
+    cache->clear();
+    cache->setSnapshotFile(dir.filePath(QStringLiteral("freebusy.snapshot")));
+    QVERIFY(cache->lastKnown(QStringLiteral("carol@demo.kolab.org")));
+    QVERIFY(cache->lastKnown(QStringLiteral("dave@demo.kolab.org")));
+
+    // disabled, the file is removed instead of saved
+    IncidenceEditorSettings::self()->setFreeBusySnapshot(false);
+    QVERIFY(!cache->saveSnapshot());
+    QVERIFY(!QFile::exists(dir.filePath(QStringLiteral("freebusy.snapshot"))));
+    QVERIFY(!cache->lastKnown(QStringLiteral("dave@demo.kolab.org")));
+    IncidenceEditorSettings::self()->setFreeBusySnapshot(true);
+
+    // garbage is ignored
+    cache->setSnapshotFile(QString());
+    QFile file(dir.filePath(QStringLiteral("freebusy.snapshot")));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(QByteArray(64, 'x'));
+    file.close();
+    cache->setSnapshotFile(file.fileName());
+    QVERIFY(!cache->lastKnown(QStringLiteral("albert@einstein.net")));
+    cache->setSnapshotFile(QString());
+    IncidenceEditorSettings::self()->setFreeBusySnapshot(false);
+}
+
+void ConflictResolverTest::testFreeBusyFetchQueue()
+{
+    FreeBusyCache *cache = FreeBusyCache::self();
+    QStringList fetched;
+    cache->setFetcher([&fetched](const QString &email, QWidget *) {
+        fetched << email;
+        return true;
+    });
+    cache->setMaximumFetches(3);
+    const KCalendarCore::FreeBusy::Ptr freebusy(new KCalendarCore::FreeBusy(KCalendarCore::Period::List()));
+
+    cache->request(QStringLiteral("a1@one.org"), nullptr, FreeBusyCache::LowFetchPriority);
+    cache->request(QStringLiteral("a2@one.org"), nullptr, FreeBusyCache::LowFetchPriority);
+    cache->request(QStringLiteral("a3@one.org"), nullptr, FreeBusyCache::HighFetchPriority);
+    cache->request(QStringLiteral("b1@two.org"), nullptr, FreeBusyCache::LowFetchPriority);
+    cache->request(QStringLiteral("b2@two.org"), nullptr, FreeBusyCache::LowFetchPriority);
+    cache->request(QStringLiteral("a1@one.org"), nullptr, FreeBusyCache::HighFetchPriority);
+    // at most two fetches per host and three in total
+    QCOMPARE(fetched, QStringList({QStringLiteral("a1@one.org"), QStringLiteral("a2@one.org"), QStringLiteral("b1@two.org")}));
+    QVERIFY(cache->isFetching(QStringLiteral("a3@one.org")));
+    QVERIFY(cache->isFetching(QStringLiteral("B2@two.org")));
+
+    // a queued fetch of higher priority moves forward, but waits for its host
+    cache->request(QStringLiteral("b2@two.org"), nullptr, FreeBusyCache::HighFetchPriority);
+    cache->insert(QStringLiteral("b1@two.org"), freebusy);
+    QCOMPARE(fetched.size(), 4);
+    QCOMPARE(fetched.last(), QStringLiteral("b2@two.org"));
+    cache->insert(QStringLiteral("a1@one.org"), freebusy);
+    QCOMPARE(fetched.size(), 5);
+    QCOMPARE(fetched.last(), QStringLiteral("a3@one.org"));
+
+    // a cached email isn't fetched again
+    cache->request(QStringLiteral("a1@one.org"));
+    QCOMPARE(fetched.size(), 5);
+
+    cache->insert(QStringLiteral("a2@one.org"), freebusy);
+    cache->insert(QStringLiteral("a3@one.org"), freebusy);
+    cache->insert(QStringLiteral("b2@two.org"), freebusy);
+    QVERIFY(!cache->isFetching(QStringLiteral("a3@one.org")));
+    cache->setFetcher({});
+    cache->setMaximumFetches(4);
+    cache->clear();
+}
+
+void ConflictResolverTest::testSetAttendees()
+{
+    FreeBusyCache *cache = FreeBusyCache::self();
+    QStringList fetched;
+    cache->setFetcher([&fetched](const QString &email, QWidget *) {
+        fetched << email;
+        return true;
+    });
+
+    KCalendarCore::Period::List busy;
+    busy << KCalendarCore::Period(base, base.addSecs(60 * 60));
+    addAttendee(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    addAttendee(QStringLiteral("kdabtest1@demo.kolab.org"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    insertAttendees();
+    CalendarSupport::FreeBusyItemModel *model = resolver->model();
+    const auto freebusy = model->data(model->index(0), CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
+    QSignalSpy conflictSpy(resolver, &ConflictResolver::conflictsDetected);
+    resolver->setMandatoryRoles({KCalendarCore::Attendee::ReqParticipant, KCalendarCore::Attendee::OptParticipant});
+    resolver->setEarliestDateTime(base);
+    resolver->setLatestDateTime(base.addSecs(60 * 60));
+    QCOMPARE(conflictSpy.last().at(0).toInt(), 2);
+    QSignalSpy insertedSpy(model, &QAbstractItemModel::rowsInserted);
+    QSignalSpy removedSpy(model, &QAbstractItemModel::rowsRemoved);
+
+    // albert is renamed, the row stays in place with its free/busy info
+    const KCalendarCore::Attendee oldAlbert = attendees.at(0)->attendee();
+    KCalendarCore::Attendee albert = oldAlbert;
+    albert.setName(QStringLiteral("Albert Einstein"));
+    KCalendarCore::Attendee kdabtest1 = attendees.at(1)->attendee();
+    resolver->setAttendees({albert, kdabtest1});
+    QCOMPARE(model->rowCount(), 2);
+    QCOMPARE(model->data(model->index(0), CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>(), albert);
+    QCOMPARE(model->data(model->index(0), Qt::DisplayRole).toString(), albert.fullName());
+    QCOMPARE(model->data(model->index(0), CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>(), freebusy);
+    QCOMPARE(model->data(model->index(1), CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>(), kdabtest1);
+    QVERIFY(resolver->containsAttendee(albert));
+    QVERIFY(!resolver->containsAttendee(oldAlbert));
+    QCOMPARE(conflictSpy.last().at(0).toInt(), 2);
+
+    // a role which isn't mandatory stops kdabtest1 from conflicting, still in place
+    kdabtest1.setRole(KCalendarCore::Attendee::NonParticipant);
+    resolver->setAttendees({albert, kdabtest1});
+    QCOMPARE(model->data(model->index(1), CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>(), kdabtest1);
+    QCOMPARE(conflictSpy.last().at(0).toInt(), 1);
+    QCOMPARE(insertedSpy.count(), 0);
+    QCOMPARE(removedSpy.count(), 0);
+    QVERIFY(fetched.isEmpty());
+
+    // kdabtest1 leaves and kdabtest2 joins
+    const KCalendarCore::Attendee newcomer(QStringLiteral("attendee 2"), QStringLiteral("kdabtest2@demo.kolab.org"));
+    resolver->setAttendees({albert, newcomer, KCalendarCore::Attendee(QStringLiteral("nobody"), QString())});
+
+    QCOMPARE(model->rowCount(), 2);
+    QVERIFY(!resolver->containsAttendee(kdabtest1));
+    QVERIFY(resolver->containsAttendee(newcomer));
+    QCOMPARE(model->data(model->index(0), CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>(), albert);
+    QCOMPARE(fetched, QStringList({newcomer.email()}));
+
+    // nothing changes
+    resolver->setAttendees({albert, newcomer});
+    QCOMPARE(model->rowCount(), 2);
+    QCOMPARE(fetched.size(), 1);
+
+    // the renamed attendee is removed by its new name
+    resolver->removeAttendee(albert);
+    QCOMPARE(model->rowCount(), 1);
+
+    cache->insert(newcomer.email(), freebusy);
+    cache->setFetcher({});
+    cache->clear();
+}
+
+void ConflictResolverTest::testIsBusy()
+{
+    KCalendarCore::Period::List busy;
+    busy << KCalendarCore::Period(base.addSecs(60 * 60), base.addSecs(2 * 60 * 60));
+    addAttendee(QStringLiteral("albert@einstein.net"), KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(busy)));
+    insertAttendees();
+
+    QVERIFY(resolver->isBusy(0, base.addSecs(90 * 60), base.addSecs(100 * 60)));
+    QVERIFY(resolver->isBusy(0, base, base.addSecs(3 * 60 * 60)));
+    // the end of the range is included, the end of the busy period isn't
+    QVERIFY(resolver->isBusy(0, base, base.addSecs(60 * 60)));
+    QVERIFY(!resolver->isBusy(0, base, base.addSecs(60 * 60 - 1)));
+    QVERIFY(!resolver->isBusy(0, base.addSecs(2 * 60 * 60), base.addSecs(3 * 60 * 60)));
+    QVERIFY(!resolver->isBusy(1, base, base.addSecs(3 * 60 * 60)));
+}
+
 QTEST_MAIN(ConflictResolverTest)
 
 #include "moc_conflictresolvertest.cpp"
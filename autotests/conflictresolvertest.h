@@ -33,6 +33,30 @@ private Q_SLOTS:
     void testPeriodEndsAfterTimeframeEnds();
     void testPeriodIsLargerThenTimeframe();
     void testPeriodEndsAtSametimeAsTimeframe();
+    void testIntervalSweepEngine();
+    void testIntervalSweepEngineWeekdays();
+    void testIncrementalFreeBusyUpdate();
+    void testFirstFreeBusyPeriods();
+    void testAsyncFreeSlotSearch();
+    void testNextFreeSlot();
+    void testWorkingHours_data();
+    void testWorkingHours();
+    void testRankedSlots();
+    void testConstraintsUpdate();
+    void testRecurringFreeSlots();
+    void testSecondResolutionLongTimeframe();
+    void testFirstFreeSlot();
+    void testUnalignedBusyPeriod();
+    void testProgressiveFreeSlots();
+    void testConflictHistogram();
+    void testStatusWeights();
+    void testRoomSlots();
+    void testScheduleMeetings();
+    void testFreeBusyCache();
+    void testFreeBusySnapshot();
+    void testFreeBusyFetchQueue();
+    void testSetAttendees();
+    void testIsBusy();
 
 private:
     void insertAttendees();
@@ -5,13 +5,22 @@
 */
 
 #include <QObject>
+#include <QSignalSpy>
+#include <QTableView>
 #include <QTest>
 
+#include <CalendarSupport/FreeBusyItemModel>
+
+#include "attendeetablemodel.h"
 #include "combinedincidenceeditor.h"
+#include "conflictresolver.h"
+#include "freebusycache.h"
 #include "incidencedatetime.h"
 #include "incidencedialog.h"
 #include "ui_dialogdesktop.h"
 
+#include <algorithm>
+
 using namespace IncidenceEditorNG;
 
 class IncidenceDateTimeTest : public QObject
@@ -231,6 +240,70 @@ private Q_SLOTS:
         QVERIFY(!mEndTime->isEnabled());
         QVERIFY(!mEndZone->isVisible());
     }
+
+    void testCoalescedDurationChanges()
+    {
+        // nothing is fetched, the free/busy info is inserted below
+        FreeBusyCache::self()->setFetcher([](const QString &, QWidget *) {
+            return true;
+        });
+
+        const QDate date{2022, 04, 11};
+        const QTimeZone zone{"Etc/UTC"};
+        const QString email = QStringLiteral("albert@einstein.net");
+
+        KCalendarCore::Event::Ptr event(new KCalendarCore::Event);
+        event->setSummary(QStringLiteral("e"));
+        event->setDtStart(QDateTime{date, QTime{10, 0}, zone});
+        event->setDtEnd(QDateTime{date, QTime{11, 0}, zone});
+        event->setAllDay(false);
+        event->addAttendee(KCalendarCore::Attendee(QStringLiteral("Albert"), email));
+        Akonadi::Item item;
+        item.setPayload<KCalendarCore::Event::Ptr>(event);
+        mDialog->load(item);
+
+        auto resolver = mDialog->findChild<ConflictResolver *>();
+        QVERIFY2(resolver, "Couldn't find the conflict resolver.");
+        auto attendeeTable = mDialog->findChild<QTableView *>(QStringLiteral("mAttendeeTable"));
+        QVERIFY2(attendeeTable, "Couldn't find the attendee table.");
+        QAbstractItemModel *attendeeModel = attendeeTable->model();
+        QCOMPARE(resolver->model()->rowCount(), 1);
+
+        // busy from 14:00 to 16:00, so free during the event
+        const KCalendarCore::Period busy(QDateTime{date, QTime{14, 0}, zone}, QDateTime{date, QTime{16, 0}, zone});
+        resolver->model()->slotInsertFreeBusy(KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(KCalendarCore::Period::List{busy})), email);
+        QTest::qWait(100);
+
+        QSignalSpy conflictSpy(resolver, &ConflictResolver::conflictsDetected);
+        QSignalSpy dataChangedSpy(attendeeModel, &QAbstractItemModel::dataChanged);
+        const auto availableChanges = [&dataChangedSpy]() {
+            return std::count_if(dataChangedSpy.cbegin(), dataChangedSpy.cend(), [](const QList<QVariant> &arguments) {
+                return arguments.at(0).toModelIndex().column() == AttendeeTableModel::Available;
+            });
+        };
+
+        // a burst of edits in one event loop turn, into the busy period, out of it and back
+        mEndTime->setTime(QTime{15, 0});
+        mEndTime->setTime(QTime{11, 30});
+        mEndTime->setTime(QTime{15, 30});
+        mEndDate->setDate(date.addDays(1));
+        mEndDate->setDate(date);
+        QCOMPARE(conflictSpy.count(), 0);
+        QCOMPARE(availableChanges(), 0);
+
+        // folded into a single resolver update and a single availability refresh
+        QTRY_COMPARE(conflictSpy.count(), 1);
+        QTest::qWait(100);
+        QCOMPARE(conflictSpy.count(), 1);
+        QCOMPARE(conflictSpy.at(0).at(0).toInt(), 1);
+        QCOMPARE(availableChanges(), 1);
+        const QModelIndexList rows = attendeeModel->match(attendeeModel->index(0, AttendeeTableModel::Email), Qt::DisplayRole, email, 1, Qt::MatchFixedString);
+        QCOMPARE(rows.size(), 1);
+        QCOMPARE(rows.at(0).siblingAtColumn(AttendeeTableModel::Available).data(Qt::EditRole).toInt(), int(AttendeeTableModel::Busy));
+
+        FreeBusyCache::self()->setFetcher({});
+        FreeBusyCache::self()->clear();
+    }
 };
 
 QTEST_MAIN(IncidenceDateTimeTest)
@@ -7,6 +7,8 @@
 
 #include "attendeeline.h"
 #include "attendeedata.h"
+#include "freebusycache.h"
+#include "incidenceeditorsettings.h"
 
 #include <KCalUtils/Stringify>
 
@@ -24,6 +26,8 @@ using namespace IncidenceEditorNG;
 
 using TextIconPair = QPair<QString, QIcon>;
 
+static const int PREFETCH_DELAY_MSECS = 300; // the completion of a few more key strokes is usually the same
+
 AttendeeComboBox::AttendeeComboBox(QWidget *parent)
     : QToolButton(parent)
     , mMenu(new QMenu(this))
@@ -100,6 +104,51 @@ void AttendeeComboBox::keyPressEvent(QKeyEvent *ev)
 AttendeeLineEdit::AttendeeLineEdit(QWidget *parent)
     : AddresseeLineEdit(parent, true)
 {
+    // fetch the free/busy info before the attendee is added, so its availability is known right away.
+    // Always connected, the setting is checked when prefetching, so changing it takes effect at once.
+    mPrefetchTimer.setSingleShot(true);
+    mPrefetchTimer.setInterval(PREFETCH_DELAY_MSECS);
+    connect(&mPrefetchTimer, &QTimer::timeout, this, &AttendeeLineEdit::prefetchCompletion);
+    connect(this, &AttendeeLineEdit::textEdited, &mPrefetchTimer, qOverload<>(&QTimer::start));
+    connect(this, &AttendeeLineEdit::editingFinished, this, [this]() {
+        prefetch(text());
+    });
+    connect(this, &AttendeeLineEdit::textCompleted, this, [this]() {
+        prefetch(text());
+    });
+}
+
+void AttendeeLineEdit::prefetchCompletion()
+{
+    if (!IncidenceEditorSettings::self()->prefetchFreeBusy()) {
+        return;
+    }
+    // the first completion with an address, the box starts with the name of the address book
+    const KCompletionBox *box = completionBox(false);
+    if (box && box->isVisible()) {
+        for (int i = 0; i < box->count(); ++i) {
+            if (prefetch(box->item(i)->text())) {
+                return;
+            }
+        }
+    }
+    prefetch(text());
+}
+
+bool AttendeeLineEdit::prefetch(const QString &address)
+{
+    if (!IncidenceEditorSettings::self()->prefetchFreeBusy()) {
+        return false;
+    }
+    QString email;
+    QString name;
+    KEmailAddress::extractEmailAddressAndName(address, email, name);
+    if (!KEmailAddress::isValidSimpleAddress(email)) {
+        return false;
+    }
+    // only a guess, the attendees which are added are fetched first
+    FreeBusyCache::self()->request(email, window(), FreeBusyCache::LowFetchPriority);
+    return true;
 }
 
 void AttendeeLineEdit::keyPressEvent(QKeyEvent *ev)
@@ -13,6 +13,7 @@
 #include <KCalendarCore/Attendee>
 
 #include <QCheckBox>
+#include <QTimer>
 #include <QToolButton>
 
 class QKeyEvent;
@@ -67,6 +68,12 @@ Q_SIGNALS:
 
 protected:
     void keyPressEvent(QKeyEvent *ev) override;
+
+private:
+    void prefetchCompletion();
+    bool prefetch(const QString &address);
+
+    QTimer mPrefetchTimer;
 };
 
 class AttendeeLine : public KPIM::MultiplyingLine
@@ -10,6 +10,8 @@
 
 #include <KLocalizedString>
 
+#include <algorithm>
+
 using namespace IncidenceEditorNG;
 
 AttendeeTableModel::AttendeeTableModel(QObject *parent)
@@ -226,6 +228,24 @@ KCalendarCore::Attendee::List AttendeeTableModel::attendees() const
     return mAttendeeList;
 }
 
+void AttendeeTableModel::setAvailableStatuses(const QHash<int, AvailableStatus> &statuses)
+{
+    int first = rowCount();
+    int last = -1;
+    for (auto it = statuses.cbegin(), end = statuses.cend(); it != end; ++it) {
+        const int row = it.key();
+        if (row < 0 || row >= rowCount() || mAttendeeAvailable[row] == it.value()) {
+            continue;
+        }
+        mAttendeeAvailable[row] = it.value();
+        first = std::min(first, row);
+        last = std::max(last, row);
+    }
+    if (first <= last) {
+        Q_EMIT dataChanged(index(first, Available), index(last, Available));
+    }
+}
+
 void AttendeeTableModel::addEmptyAttendee()
 {
     if (mKeepEmpty) {
@@ -9,6 +9,7 @@
 #include <KCalendarCore/Attendee>
 
 #include <QAbstractTableModel>
+#include <QHash>
 #include <QModelIndex>
 #include <QSortFilterProxyModel>
 
@@ -43,6 +44,12 @@ public:
     void setAttendees(const KCalendarCore::Attendee::List &resources);
     [[nodiscard]] KCalendarCore::Attendee::List attendees() const;
 
+    /**
+     * Sets the Available column of several rows at once, with a single dataChanged() for them.
+     * @param statuses the new status by row
+     */
+    void setAvailableStatuses(const QHash<int, AvailableStatus> &statuses);
+
     void setKeepEmpty(bool keepEmpty);
     [[nodiscard]] bool keepEmpty() const;
 
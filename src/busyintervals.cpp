@@ -0,0 +1,108 @@
+/*
+  SPDX-FileCopyrightText: 2026 KDE PIM developers <kde-pim@kde.org>
+
+  SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "busyintervals.h"
+
+#include <algorithm>
+
+using namespace IncidenceEditorNG;
+
+BusyIntervals::BusyIntervals(const KCalendarCore::Period::List &periods)
+{
+    mIntervals.reserve(periods.size());
+    for (const KCalendarCore::Period &period : periods) {
+        const qint64 start = period.start().toSecsSinceEpoch();
+        const qint64 end = period.end().toSecsSinceEpoch();
+        if (start < end) {
+            mIntervals.append({start, end});
+        }
+    }
+    normalize();
+}
+
+BusyIntervals::BusyIntervals(QList<Interval> intervals)
+    : mIntervals(std::move(intervals))
+{
+    mIntervals.removeIf([](const Interval &interval) {
+        return interval.start >= interval.end;
+    });
+    normalize();
+}
+
+void BusyIntervals::normalize()
+{
+    std::sort(mIntervals.begin(), mIntervals.end(), [](const Interval &left, const Interval &right) {
+        return left.start < right.start;
+    });
+
+    // merge overlapping and adjacent intervals
+    qsizetype merged = 0;
+    for (qsizetype i = 1; i < mIntervals.size(); ++i) {
+        Interval &last = mIntervals[merged];
+        if (mIntervals.at(i).start <= last.end) {
+            last.end = std::max(last.end, mIntervals.at(i).end);
+        } else {
+            mIntervals[++merged] = mIntervals.at(i);
+        }
+    }
+    if (!mIntervals.isEmpty()) {
+        mIntervals.resize(merged + 1);
+    }
+}
+
+bool BusyIntervals::isEmpty() const
+{
+    return mIntervals.isEmpty();
+}
+
+qsizetype BusyIntervals::size() const
+{
+    return mIntervals.size();
+}
+
+const BusyIntervals::Interval &BusyIntervals::at(qsizetype i) const
+{
+    return mIntervals.at(i);
+}
+
+bool BusyIntervals::overlaps(qint64 from, qint64 to) const
+{
+    const qsizetype i = firstEndingAfter(from, 0);
+    return i < mIntervals.size() && mIntervals.at(i).start < to;
+}
+
+qint64 BusyIntervals::nextFree(qint64 from, qint64 duration, qsizetype &cursor) const
+{
+    cursor = firstEndingAfter(from, cursor);
+    // the intervals are merged, so each one that blocks [from, from + duration)
+    // pushes from to its end, which is before the start of the next one
+    while (cursor < mIntervals.size() && mIntervals.at(cursor).start < from + duration) {
+        from = mIntervals.at(cursor).end;
+        ++cursor;
+    }
+    return from;
+}
+
+qsizetype BusyIntervals::firstEndingAfter(qint64 t, qsizetype cursor) const
+{
+    const qsizetype count = mIntervals.size();
+    if (cursor >= count || mIntervals.at(cursor).end > t) {
+        return cursor;
+    }
+    // gallop: probe cursor + 1, + 2, + 4, ... until an interval ends after t,
+    // then binary search the last step
+    qsizetype low = cursor; // ends at or before t
+    qsizetype step = 1;
+    while (low + step < count && mIntervals.at(low + step).end <= t) {
+        low += step;
+        step *= 2;
+    }
+    const qsizetype high = std::min(low + step, count);
+    const auto it = std::partition_point(mIntervals.cbegin() + low + 1, mIntervals.cbegin() + high, [t](const Interval &interval) {
+        return interval.end <= t;
+    });
+    return it - mIntervals.cbegin();
+}
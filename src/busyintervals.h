@@ -0,0 +1,66 @@
+/*
+  SPDX-FileCopyrightText: 2026 KDE PIM developers <kde-pim@kde.org>
+
+  SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "incidenceeditor_private_export.h"
+
+#include <KCalendarCore/Period>
+
+#include <QList>
+
+namespace IncidenceEditorNG
+{
+/**
+ * The busy periods of one attendee as sorted, merged intervals of seconds since epoch.
+ *
+ * Overlapping and adjacent periods are merged, so every gap between two
+ * intervals is free time. Lookups are answered by galloping from a cursor,
+ * which makes a series of lookups with increasing times cost O(log n) each
+ * in the worst case and O(1) when the times are close together.
+ */
+class INCIDENCEEDITOR_TESTS_EXPORT BusyIntervals
+{
+public:
+    struct Interval {
+        qint64 start; //!< seconds since epoch, inclusive
+        qint64 end; //!< seconds since epoch, exclusive
+    };
+
+    BusyIntervals() = default;
+    explicit BusyIntervals(const KCalendarCore::Period::List &periods);
+    explicit BusyIntervals(QList<Interval> intervals);
+
+    [[nodiscard]] bool isEmpty() const;
+    [[nodiscard]] qsizetype size() const;
+    [[nodiscard]] const Interval &at(qsizetype i) const;
+
+    /**
+     * Returns whether any busy interval overlaps [from, to).
+     */
+    [[nodiscard]] bool overlaps(qint64 from, qint64 to) const;
+
+    /**
+     * Returns the earliest time >= from at which the attendee is free for
+     * duration seconds.
+     * @param cursor position to start looking from, updated for the next call.
+     * Start with 0 and only reuse it for calls with the same or a later from.
+     */
+    [[nodiscard]] qint64 nextFree(qint64 from, qint64 duration, qsizetype &cursor) const;
+
+private:
+    void normalize();
+
+    /**
+     * Returns the index of the first interval ending after t, starting at cursor.
+     */
+    [[nodiscard]] qsizetype firstEndingAfter(qint64 t, qsizetype cursor) const;
+
+    QList<Interval> mIntervals;
+};
+}
+
+Q_DECLARE_TYPEINFO(IncidenceEditorNG::BusyIntervals::Interval, Q_PRIMITIVE_TYPE);
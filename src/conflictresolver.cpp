@@ -8,24 +8,254 @@
 */
 
 #include "conflictresolver.h"
+#include "freebusyattendeemodel.h"
+#include "freebusycache.h"
 #include "incidenceeditor_debug.h"
 #include <CalendarSupport/FreeBusyItemModel>
 
 #include <QDate>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QPromise>
+#include <QTimeZone>
+#include <QtAlgorithms>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
 
 static const int DEFAULT_RESOLUTION_SECONDS = 15 * 60; // 15 minutes, 1 slot = 15 minutes
+static const int DEFAULT_SEARCH_HORIZON_DAYS = 365; // don't look more than one year in the future
+static const qsizetype CANCEL_CHECK_INTERVAL = 4096; // busy intervals swept between checks for a canceled search
+
+namespace
+{
+using SlotRun = IncidenceEditorNG::ConflictResolver::SlotRun;
+
+// Adds delta busy attendees to every run, as changes of the count at the run boundaries
+void addSlotRuns(QMap<qint64, int> &conflictDeltas, const QList<SlotRun> &runs, int delta)
+{
+    const auto addAt = [&conflictDeltas](qint64 slot, int change) {
+        auto it = conflictDeltas.find(slot);
+        if (it == conflictDeltas.end()) {
+            conflictDeltas.insert(slot, change);
+        } else if ((*it += change) == 0) {
+            conflictDeltas.erase(it);
+        }
+    };
+    for (const SlotRun &run : runs) {
+        addAt(run.first, delta);
+        addAt(run.last, -delta);
+    }
+}
+
+// Returns the number of busy attendees in the slots [0, range) as runs of the same count
+QList<IncidenceEditorNG::ConflictResolver::ConflictHistogram::Run> histogramRuns(const QMap<qint64, int> &conflictDeltas, qint64 range)
+{
+    QList<IncidenceEditorNG::ConflictResolver::ConflictHistogram::Run> runs;
+    runs.reserve(conflictDeltas.size() + 1);
+    int count = 0;
+    qint64 from = 0;
+    for (auto it = conflictDeltas.cbegin(); it != conflictDeltas.cend() && it.key() < range; ++it) {
+        if (it.key() > from) {
+            runs.append({from, it.key(), count});
+            from = it.key();
+        }
+        count += it.value();
+    }
+    if (from < range) {
+        runs.append({from, range, count});
+    }
+    return runs;
+}
+
+// Returns the runs in which at least one attendee is busy
+QList<SlotRun> busyRuns(const QMap<qint64, int> &conflictDeltas)
+{
+    QList<SlotRun> runs;
+    int count = 0;
+    qint64 busyBegin = 0;
+    for (auto it = conflictDeltas.cbegin(); it != conflictDeltas.cend(); ++it) {
+        const int previous = count;
+        count += it.value();
+        if (previous == 0 && count > 0) {
+            busyBegin = it.key();
+        } else if (previous > 0 && count == 0) {
+            runs.append({busyBegin, it.key()});
+        }
+    }
+    return runs;
+}
+
+// Sorts the runs and merges the overlapping and adjacent ones
+void normalizeRuns(QList<SlotRun> &runs)
+{
+    std::sort(runs.begin(), runs.end(), [](const SlotRun &left, const SlotRun &right) {
+        return left.first < right.first;
+    });
+    qsizetype merged = -1;
+    for (const SlotRun &run : std::as_const(runs)) {
+        if (run.first >= run.last) {
+            continue;
+        }
+        if (merged >= 0 && run.first <= runs.at(merged).last) {
+            runs[merged].last = std::max(runs.at(merged).last, run.last);
+        } else {
+            runs[++merged] = run;
+        }
+    }
+    runs.resize(merged + 1);
+}
+
+// Returns the union of two lists of sorted, merged runs, sorted and merged as well
+QList<SlotRun> unionRuns(const QList<SlotRun> &left, const QList<SlotRun> &right)
+{
+    QList<SlotRun> runs;
+    runs.reserve(left.size() + right.size());
+    qsizetype l = 0;
+    qsizetype r = 0;
+    while (l < left.size() || r < right.size()) {
+        const bool takeLeft = r == right.size() || (l < left.size() && left.at(l).first <= right.at(r).first);
+        const SlotRun &run = takeLeft ? left.at(l++) : right.at(r++);
+        if (!runs.isEmpty() && run.first <= runs.last().last) {
+            runs.last().last = std::max(runs.last().last, run.last);
+        } else {
+            runs.append(run);
+        }
+    }
+    return runs;
+}
+
+// Returns the runs of [0, range) not covered by the sorted, merged runs
+QList<SlotRun> complementRuns(const QList<SlotRun> &runs, qint64 range)
+{
+    QList<SlotRun> gaps;
+    qint64 from = 0;
+    for (const SlotRun &run : runs) {
+        if (run.first > from) {
+            gaps.append({from, std::min(run.first, range)});
+        }
+        from = std::max(from, run.last);
+        if (from >= range) {
+            return gaps;
+        }
+    }
+    if (from < range) {
+        gaps.append({from, range});
+    }
+    return gaps;
+}
+
+// Returns the slots starting in the given intervals, i.e. how blocked time is put on the grid
+QList<SlotRun> slotsStartingIn(const IncidenceEditorNG::BusyIntervals &intervals, qint64 beginSecs, int resolution, qint64 range)
+{
+    QList<SlotRun> runs;
+    runs.reserve(intervals.size());
+    for (qsizetype i = 0; i < intervals.size(); ++i) {
+        // round up, for the first slot starting at or after the start of the interval
+        const qint64 first = std::clamp<qint64>((intervals.at(i).start - beginSecs + resolution - 1) / resolution, 0, range);
+        const qint64 last = std::clamp<qint64>((intervals.at(i).end - beginSecs + resolution - 1) / resolution, 0, range);
+        if (first < last) {
+            runs.append({first, last});
+        }
+    }
+    return runs;
+}
+}
 
 using namespace IncidenceEditorNG;
 
+/**
+ * A snapshot of everything a free slot search needs, so it can run on a worker thread.
+ */
+struct ConflictResolver::SearchInput {
+    quint64 generation = 0;
+    FreeSlotEngine engine = SlotGridEngine;
+    SlotGrid grid;
+    QBitArray weekdays;
+    QTime workingHoursStart;
+    QTime workingHoursEnd;
+    QTimeZone workingHoursTimeZone;
+    QList<BusyIntervals> busyIntervals; //!< per cached row, in the order of mBusyRows
+    QList<bool> counted; //!< whether the row takes part in the search
+    bool reuseGrid = false; //!< the cached slot rows match the grid, conflictDeltas is up to date
+    QMap<qint64, int> conflictDeltas;
+    int progressiveBatchSize = 0;
+    std::function<bool()> isCanceled; //!< set on the worker thread, an outdated search stops early
+
+    [[nodiscard]] bool canceled() const
+    {
+        return isCanceled && isCanceled();
+    }
+};
+
+struct ConflictResolver::SearchResult {
+    quint64 generation = 0;
+    bool searched = false; //!< false if the search was skipped, e.g. because of an invalid timeframe
+    bool partial = false; //!< only carries the next free slots of a progressive search
+    SlotGrid grid;
+    bool gridRebuilt = false;
+    QList<QList<SlotRun>> slotRuns; //!< per cached row, when gridRebuilt
+    QMap<qint64, int> conflictDeltas;
+    QList<ConflictHistogram::Run> histogram; //!< of the slot grid engine
+    KCalendarCore::Period::List freeSlots;
+};
+
+/**
+ * Collects the free slots of a progressive search. The first batch is reported as soon as
+ * it is complete, every following one is twice as large as the one before, so a long list
+ * is reported in a few batches only.
+ */
+class ConflictResolver::SlotBatchReporter
+{
+public:
+    SlotBatchReporter(KCalendarCore::Period::List &slots, int batchSize, const std::function<void(const KCalendarCore::Period::List &)> &report)
+        : mSlots(slots)
+        , mBatchSize(batchSize)
+        , mReport(report)
+    {
+    }
+
+    void add(const KCalendarCore::Period &slot)
+    {
+        mSlots << slot;
+        if (mReport && mBatchSize > 0 && mSlots.size() - mReported >= mBatchSize) {
+            flush();
+            mBatchSize *= 2;
+        }
+    }
+
+    // reports the slots which weren't reported yet
+    void flush()
+    {
+        if (mReport && mBatchSize > 0 && mReported < mSlots.size()) {
+            mReport(mSlots.mid(mReported));
+            mReported = mSlots.size();
+        }
+    }
+
+private:
+    KCalendarCore::Period::List &mSlots;
+    qsizetype mBatchSize;
+    qsizetype mReported = 0;
+    const std::function<void(const KCalendarCore::Period::List &)> &mReport;
+};
+
 ConflictResolver::ConflictResolver(QWidget *parentWidget, QObject *parent)
     : QObject(parent)
-    , mFBModel(new CalendarSupport::FreeBusyItemModel(this))
+    , mFBModel(new FreeBusyAttendeeModel(this))
+    , mRoomModel(new CalendarSupport::FreeBusyItemModel(this))
     , mParentWidget(parentWidget)
     , mWeekdays(7)
     , mSlotResolutionSeconds(DEFAULT_RESOLUTION_SECONDS)
+    , mSearchHorizonDays(DEFAULT_SEARCH_HORIZON_DAYS)
 {
     const QDateTime currentLocalDateTime = QDateTime::currentDateTime();
     mTimeframeConstraint = KCalendarCore::Period(currentLocalDateTime, currentLocalDateTime);
+    mTimeframeStart = mTimeframeEnd = currentLocalDateTime.toSecsSinceEpoch();
 
     // trigger a reload in case any attendees were inserted before
     // the connection was made
@@ -40,34 +270,57 @@ ConflictResolver::ConflictResolver(QWidget *parentWidget, QObject *parent)
     mWeekdays.setBit(5);
     mWeekdays.setBit(6); // Sunday
 
+    mRoleWeights.insert(KCalendarCore::Attendee::Chair, 2);
+    mRoleWeights.insert(KCalendarCore::Attendee::ReqParticipant, 2);
+    mRoleWeights.insert(KCalendarCore::Attendee::OptParticipant, 1);
+    mRoleWeights.insert(KCalendarCore::Attendee::NonParticipant, 0);
+
+    // tentative periods are soft conflicts, free ones no conflicts at all
+    mStatusWeights.insert(KCalendarCore::FreeBusyPeriod::Free, 0);
+    mStatusWeights.insert(KCalendarCore::FreeBusyPeriod::Busy, 100);
+    mStatusWeights.insert(KCalendarCore::FreeBusyPeriod::BusyUnavailable, 100);
+    mStatusWeights.insert(KCalendarCore::FreeBusyPeriod::BusyTentative, 50);
+    mStatusWeights.insert(KCalendarCore::FreeBusyPeriod::Unknown, 100);
+
     mMandatoryRoles.reserve(4);
     mMandatoryRoles << KCalendarCore::Attendee::ReqParticipant << KCalendarCore::Attendee::OptParticipant << KCalendarCore::Attendee::NonParticipant
                     << KCalendarCore::Attendee::Chair;
 
-    connect(mFBModel, &CalendarSupport::FreeBusyItemModel::dataChanged, this, &ConflictResolver::freebusyDataChanged);
+    // keep the busy row cache in sync with the model, touching only the rows that changed
+    connect(mFBModel, &CalendarSupport::FreeBusyItemModel::rowsInserted, this, &ConflictResolver::slotFreeBusyRowsInserted);
+    connect(mFBModel, &CalendarSupport::FreeBusyItemModel::rowsAboutToBeRemoved, this, &ConflictResolver::slotFreeBusyRowsAboutToBeRemoved);
+    connect(mFBModel, &CalendarSupport::FreeBusyItemModel::dataChanged, this, &ConflictResolver::slotFreeBusyRowsChanged);
+    connect(mFBModel, &CalendarSupport::FreeBusyItemModel::modelReset, this, &ConflictResolver::freebusyDataChanged);
+    connect(mFBModel, &CalendarSupport::FreeBusyItemModel::layoutChanged, this, &ConflictResolver::freebusyDataChanged);
+    // the cache delivers the info the models miss when the letter case of an email differs
+    connect(FreeBusyCache::self(), &FreeBusyCache::freeBusyCached, mFBModel, &CalendarSupport::FreeBusyItemModel::slotInsertFreeBusy);
+    connect(FreeBusyCache::self(), &FreeBusyCache::freeBusyCached, mRoomModel, &CalendarSupport::FreeBusyItemModel::slotInsertFreeBusy);
 
-    connect(&mCalculateTimer, &QTimer::timeout, this, &ConflictResolver::findAllFreeSlots);
+    connect(&mCalculateTimer, &QTimer::timeout, this, &ConflictResolver::startFreeSlotSearch);
     mCalculateTimer.setSingleShot(true);
 }
 
 void ConflictResolver::insertAttendee(const KCalendarCore::Attendee &attendee)
 {
-    if (!mFBModel->containsAttendee(attendee)) {
-        mFBModel->addItem(CalendarSupport::FreeBusyItem::Ptr(new CalendarSupport::FreeBusyItem(attendee, mParentWidget)));
+    if (!containsAttendee(attendee)) {
+        // the free/busy info is shared with the other editors, the mandatory attendees are fetched first
+        const FreeBusyCache::FetchPriority priority = matchesRoleConstraint(attendee) ? FreeBusyCache::HighFetchPriority : FreeBusyCache::LowFetchPriority;
+        mFBModel->addItem(FreeBusyCache::self()->createItem(attendee, mParentWidget, priority));
     }
 }
 
 void ConflictResolver::insertAttendee(const CalendarSupport::FreeBusyItem::Ptr &freebusy)
 {
-    if (!mFBModel->containsAttendee(freebusy->attendee())) {
+    if (!containsAttendee(freebusy->attendee())) {
         mFBModel->addItem(freebusy);
     }
 }
 
 void ConflictResolver::removeAttendee(const KCalendarCore::Attendee &attendee)
 {
-    mFBModel->removeAttendee(attendee);
-    calculateConflicts();
+    // the busy row cache is updated through rowsAboutToBeRemoved
+    const int row = busyRowOf(attendee);
+    mFBModel->removeAttendee(row >= 0 ? mFBModel->itemAttendee(row) : attendee);
 }
 
 void ConflictResolver::clearAttendees()
@@ -75,364 +328,1169 @@ void ConflictResolver::clearAttendees()
     mFBModel->clear();
 }
 
+void ConflictResolver::setAttendees(const KCalendarCore::Attendee::List &attendees)
+{
+    QHash<QString, KCalendarCore::Attendee> wanted;
+    for (const KCalendarCore::Attendee &attendee : attendees) {
+        if (!attendee.email().isEmpty()) {
+            wanted.insert(attendee.email().toLower(), attendee);
+        }
+    }
+
+    // the rows are collected first, removing them changes the row numbers
+    QList<KCalendarCore::Attendee> removed;
+    FreeBusyCache *cache = FreeBusyCache::self();
+    for (int i = 0; i < mBusyRows.size(); ++i) {
+        const KCalendarCore::Attendee current = mBusyRows.at(i).attendee;
+        const auto it = wanted.constFind(current.email().toLower());
+        if (it == wanted.cend()) {
+            removed << current;
+            continue;
+        }
+        if (!(*it == current)) {
+            // same email, so the row keeps its place and its free/busy info, the busy row
+            // and its conflicts are updated through dataChanged
+            mFBModel->setAttendee(i, *it);
+            if (matchesRoleConstraint(*it) && cache->isFetching(it->email())) {
+                cache->request(it->email(), mParentWidget, FreeBusyCache::HighFetchPriority);
+            }
+        }
+        wanted.erase(it);
+    }
+
+    for (const KCalendarCore::Attendee &attendee : std::as_const(removed)) {
+        removeAttendee(attendee);
+    }
+    // the ones left are new, in the order they were given
+    for (const KCalendarCore::Attendee &attendee : attendees) {
+        if (wanted.contains(attendee.email().toLower())) {
+            insertAttendee(attendee);
+            wanted.remove(attendee.email().toLower());
+        }
+    }
+}
+
+bool ConflictResolver::isBusy(int row, const QDateTime &start, const QDateTime &end) const
+{
+    if (row < 0 || row >= mBusyRows.size()) {
+        return false;
+    }
+    return mBusyRows.at(row).busyIntervals.overlaps(start.toSecsSinceEpoch(), end.toSecsSinceEpoch() + 1);
+}
+
 bool ConflictResolver::containsAttendee(const KCalendarCore::Attendee &attendee)
 {
-    return mFBModel->containsAttendee(attendee);
+    return busyRowOf(attendee) >= 0;
+}
+
+int ConflictResolver::busyRowOf(const KCalendarCore::Attendee &attendee) const
+{
+    // the busy rows hold the attendees as shown, which may differ from the ones of the items
+    const auto it = std::find_if(mBusyRows.cbegin(), mBusyRows.cend(), [&attendee](const BusyRow &row) {
+        return row.attendee == attendee;
+    });
+    return it == mBusyRows.cend() ? -1 : int(std::distance(mBusyRows.cbegin(), it));
+}
+
+void ConflictResolver::insertRoom(const KCalendarCore::Attendee &room)
+{
+    if (!mRoomModel->containsAttendee(room)) {
+        mRoomModel->addItem(FreeBusyCache::self()->createItem(room, mParentWidget, FreeBusyCache::LowFetchPriority));
+    }
+}
+
+void ConflictResolver::insertRoom(const CalendarSupport::FreeBusyItem::Ptr &freebusy)
+{
+    if (!mRoomModel->containsAttendee(freebusy->attendee())) {
+        mRoomModel->addItem(freebusy);
+    }
+}
+
+void ConflictResolver::clearRooms()
+{
+    mRoomModel->clear();
+}
+
+void ConflictResolver::setTimeframe(const KCalendarCore::Period &timeframe)
+{
+    // the seconds are up to date right away, for the searches done during a constraints update
+    mTimeframeConstraint = timeframe;
+    mTimeframeStart = mTimeframeConstraint.start().toSecsSinceEpoch();
+    mTimeframeEnd = mTimeframeConstraint.end().toSecsSinceEpoch();
+    constraintsChanged();
 }
 
 void ConflictResolver::setEarliestDate(QDate newDate)
 {
     QDateTime newStart = mTimeframeConstraint.start();
     newStart.setDate(newDate);
-    mTimeframeConstraint = KCalendarCore::Period(newStart, mTimeframeConstraint.end());
-    calculateConflicts();
+    setTimeframe(KCalendarCore::Period(newStart, mTimeframeConstraint.end()));
 }
 
 void ConflictResolver::setEarliestTime(QTime newTime)
 {
     QDateTime newStart = mTimeframeConstraint.start();
     newStart.setTime(newTime);
-    mTimeframeConstraint = KCalendarCore::Period(newStart, mTimeframeConstraint.end());
-    calculateConflicts();
+    setTimeframe(KCalendarCore::Period(newStart, mTimeframeConstraint.end()));
 }
 
 void ConflictResolver::setLatestDate(QDate newDate)
 {
     QDateTime newEnd = mTimeframeConstraint.end();
     newEnd.setDate(newDate);
-    mTimeframeConstraint = KCalendarCore::Period(mTimeframeConstraint.start(), newEnd);
-    calculateConflicts();
+    setTimeframe(KCalendarCore::Period(mTimeframeConstraint.start(), newEnd));
 }
 
 void ConflictResolver::setLatestTime(QTime newTime)
 {
     QDateTime newEnd = mTimeframeConstraint.end();
     newEnd.setTime(newTime);
-    mTimeframeConstraint = KCalendarCore::Period(mTimeframeConstraint.start(), newEnd);
-    calculateConflicts();
+    setTimeframe(KCalendarCore::Period(mTimeframeConstraint.start(), newEnd));
 }
 
 void ConflictResolver::setEarliestDateTime(const QDateTime &newDateTime)
 {
-    mTimeframeConstraint = KCalendarCore::Period(newDateTime, mTimeframeConstraint.end());
-    calculateConflicts();
+    setTimeframe(KCalendarCore::Period(newDateTime, mTimeframeConstraint.end()));
 }
 
 void ConflictResolver::setLatestDateTime(const QDateTime &newDateTime)
 {
-    mTimeframeConstraint = KCalendarCore::Period(mTimeframeConstraint.start(), newDateTime);
-    calculateConflicts();
+    setTimeframe(KCalendarCore::Period(mTimeframeConstraint.start(), newDateTime));
 }
 
 void ConflictResolver::freebusyDataChanged()
 {
+    // Rebuild the whole busy row cache, the rows might have moved
+    mGridValid = false;
+    mBusyRows.clear();
+    mBusyRows.reserve(mFBModel->rowCount());
+    for (int i = 0; i < mFBModel->rowCount(); ++i) {
+        mBusyRows << createBusyRow(i);
+    }
     calculateConflicts();
 }
 
-int ConflictResolver::tryDate(QDateTime &tryFrom, QDateTime &tryTo)
+void ConflictResolver::slotFreeBusyRowsInserted(const QModelIndex &parent, int first, int last)
 {
-    int conflicts_count = 0;
-    for (int i = 0; i < mFBModel->rowCount(); ++i) {
-        QModelIndex index = mFBModel->index(i);
-        auto attendee = mFBModel->data(index, CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>();
-        if (!matchesRoleConstraint(attendee)) {
-            continue;
-        }
-        auto freebusy = mFBModel->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
-        if (!tryDate(freebusy, tryFrom, tryTo)) {
-            ++conflicts_count;
+    if (parent.isValid()) {
+        // the free/busy periods of a row were inserted, the row itself reports that via dataChanged
+        return;
+    }
+    for (int i = first; i <= last; ++i) {
+        BusyRow row = createBusyRow(i);
+        addToSlotConflicts(row, 1);
+        mConflictCount += row.conflicts ? 1 : 0;
+        mBusyRows.insert(i, row);
+    }
+    publishConflicts();
+}
+
+void ConflictResolver::slotFreeBusyRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    for (int i = last; i >= first; --i) {
+        const BusyRow &row = mBusyRows.at(i);
+        addToSlotConflicts(row, -1);
+        mConflictCount -= row.conflicts ? 1 : 0;
+        mBusyRows.removeAt(i);
+    }
+    publishConflicts();
+}
+
+void ConflictResolver::slotFreeBusyRowsChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (!topLeft.isValid() || !bottomRight.isValid()) {
+        // e.g. the first free/busy periods of an attendee, reported before the child rows exist
+        freebusyDataChanged();
+        return;
+    }
+    int first = topLeft.row();
+    int last = bottomRight.row();
+    if (topLeft.parent().isValid()) {
+        // a free/busy period changed, refresh the attendee owning it
+        first = last = topLeft.parent().row();
+    }
+    for (int i = first; i <= last && i < mBusyRows.size(); ++i) {
+        // subtract the old row from the aggregate and add the new one
+        BusyRow &row = mBusyRows[i];
+        addToSlotConflicts(row, -1);
+        mConflictCount -= row.conflicts ? 1 : 0;
+        row = createBusyRow(i);
+        addToSlotConflicts(row, 1);
+        mConflictCount += row.conflicts ? 1 : 0;
+    }
+    publishConflicts();
+}
+
+ConflictResolver::BusyRow ConflictResolver::createBusyRow(int modelRow) const
+{
+    const QModelIndex index = mFBModel->index(modelRow);
+    BusyRow row;
+    row.attendee = mFBModel->data(index, CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>();
+    const auto freebusy = mFBModel->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
+    if (freebusy) {
+        row.hasFreeBusy = true;
+        // converted once, the resolver only works on the epoch seconds from now on
+        const KCalendarCore::FreeBusyPeriod::List periods = freebusy->fullBusyPeriods();
+        QList<BusyIntervals::Interval> intervals;
+        intervals.reserve(periods.size());
+        row.statusIntervals.reserve(periods.size());
+        for (const KCalendarCore::FreeBusyPeriod &period : periods) {
+            const qint64 start = period.start().toSecsSinceEpoch();
+            const qint64 end = period.end().toSecsSinceEpoch();
+            if (start < end) {
+                intervals.append({start, end});
+                row.statusIntervals.append({start, end, period.type()});
+            }
         }
+        std::sort(row.statusIntervals.begin(), row.statusIntervals.end(), [](const StatusInterval &left, const StatusInterval &right) {
+            return left.start < right.start;
+        });
+        row.busyIntervals = BusyIntervals(intervals);
+    }
+    row.conflicts = rowConflicts(row);
+    if (mGridValid) {
+        row.slotRuns = slotRunsForIntervals(row.busyIntervals, mGrid);
     }
-    return conflicts_count;
+    return row;
 }
 
-bool ConflictResolver::tryDate(const KCalendarCore::FreeBusy::Ptr &fb, QDateTime &tryFrom, QDateTime &tryTo)
+bool ConflictResolver::rowConflicts(const BusyRow &row) const
 {
     // If we don't have any free/busy information, assume the
     // participant is free. Otherwise a participant without available
     // information would block the whole allocation.
-    if (!fb) {
-        return true;
+    if (!row.hasFreeBusy || !matchesRoleConstraint(row.attendee)) {
+        return false;
     }
+    return row.busyIntervals.overlaps(mTimeframeStart, mTimeframeEnd);
+}
+
+bool ConflictResolver::rowCountsOnGrid(const BusyRow &row) const
+{
+    return row.hasFreeBusy && matchesRoleConstraint(row.attendee);
+}
+
+QList<ConflictResolver::SlotRun> ConflictResolver::slotRunsForIntervals(const BusyIntervals &intervals, const SlotGrid &grid)
+{
+    QList<SlotRun> slotRuns;
+    qsizetype cursor = 0;
+    appendSlotRuns(slotRuns, intervals, grid, cursor, grid.endSecs - grid.beginSecs + 1);
+    return slotRuns;
+}
 
-    KCalendarCore::Period::List busyPeriods = fb->busyPeriods();
-    for (auto it = busyPeriods.begin(); it != busyPeriods.end(); ++it) {
-        if ((*it).end() <= tryFrom // busy period ends before try period
-            || (*it).start() >= tryTo) { // busy period starts after try period
+void ConflictResolver::appendSlotRuns(QList<SlotRun> &slotRuns, const BusyIntervals &intervals, const SlotGrid &grid, qsizetype &cursor, qint64 untilSecs)
+{
+    const qint64 totalSecs = grid.endSecs - grid.beginSecs;
+    for (; cursor < intervals.size(); ++cursor) {
+        const qint64 startSecs = intervals.at(cursor).start - grid.beginSecs;
+        const qint64 endSecs = intervals.at(cursor).end - grid.beginSecs;
+        if (startSecs > totalSecs || startSecs >= untilSecs) {
+            break; // the intervals are sorted, none of the remaining ones is in the timeframe
+        }
+        if (endSecs < 0) {
             continue;
+        }
+        qint64 first;
+        qint64 last; // one past the last busy slot, rounded up: a slot the period ends in isn't free
+        if (startSecs >= 0 && endSecs <= totalSecs) {
+            // case1: the period is completely in our timeframe
+            first = startSecs / grid.resolution;
+            last = std::min((endSecs + grid.resolution - 1) / grid.resolution, grid.range);
+        } else if (startSecs <= 0 && endSecs <= totalSecs) {
+            // case2: the period begins before our timeframe begins
+            first = 0;
+            last = std::min((endSecs + grid.resolution - 1) / grid.resolution, grid.range);
+        } else if (startSecs >= 0) {
+            // case3: the period ends after our timeframe ends
+            first = startSecs / grid.resolution;
+            last = grid.range;
         } else {
-            // the current busy period blocks the try period, try
-            // after the end of the current busy period
-            const qint64 secsDuration = tryFrom.secsTo(tryTo);
-            tryFrom = (*it).end();
-            tryTo = tryFrom.addSecs(secsDuration);
-            // try again with the new try period
-            tryDate(fb, tryFrom, tryTo);
-            // we had to change the date at least once
-            return false;
+            // case4: case2+case3: our timeframe is inside the period
+            first = 0;
+            last = grid.range;
+        }
+        Q_ASSERT(last <= grid.range); // sanity check
+        first = std::min(first, grid.range);
+        if (first >= last) {
+            continue;
+        }
+        // the intervals are sorted and disjoint, so the runs only touch after rounding
+        if (!slotRuns.isEmpty() && first <= slotRuns.last().last) {
+            slotRuns.last().last = std::max(slotRuns.last().last, last);
+        } else {
+            slotRuns.append({first, last});
         }
     }
-    return true;
+}
+
+void ConflictResolver::addToSlotConflicts(const BusyRow &row, int delta)
+{
+    if (!mGridValid || !rowCountsOnGrid(row)) {
+        return;
+    }
+    addSlotRuns(mConflictDeltas, row.slotRuns, delta);
+}
+
+void ConflictResolver::rebuildSlotConflicts()
+{
+    mConflictDeltas.clear();
+    for (const BusyRow &row : std::as_const(mBusyRows)) {
+        addToSlotConflicts(row, 1);
+    }
+}
+
+void ConflictResolver::setFreeSlotEngine(FreeSlotEngine engine)
+{
+    mFreeSlotEngine = engine;
+    constraintsChanged();
+}
+
+ConflictResolver::FreeSlotEngine ConflictResolver::freeSlotEngine() const
+{
+    return mFreeSlotEngine;
 }
 
 bool ConflictResolver::findFreeSlot(const KCalendarCore::Period &dateTimeRange)
 {
-    QDateTime dtFrom = dateTimeRange.start();
-    QDateTime dtTo = dateTimeRange.end();
-    if (tryDate(dtFrom, dtTo)) {
+    return nextFreeSlot(dateTimeRange).start().isValid();
+}
+
+KCalendarCore::Period ConflictResolver::nextFreeSlot(const KCalendarCore::Period &dateTimeRange) const
+{
+    const QDateTime dtFrom = dateTimeRange.start();
+    const qint64 requested = dtFrom.toSecsSinceEpoch();
+    const qint64 duration = dateTimeRange.end().toSecsSinceEpoch() - requested;
+
+    // If we don't have any free/busy information, assume the
+    // participant is free. Otherwise a participant without available
+    // information would block the whole allocation.
+    QList<const BusyIntervals *> indexes;
+    for (const BusyRow &row : std::as_const(mBusyRows)) {
+        if (rowCountsOnGrid(row) && !row.busyIntervals.isEmpty()) {
+            indexes << &row.busyIntervals;
+        }
+    }
+    const auto isFree = [&indexes, duration](qint64 from) {
+        return std::none_of(indexes.cbegin(), indexes.cend(), [from, duration](const BusyIntervals *index) {
+            return index->overlaps(from, from + duration);
+        });
+    };
+    if (isFree(requested)) {
         // Current time is acceptable
-        return true;
+        return dateTimeRange;
     }
 
-    QDateTime tryFrom = dtFrom;
-    QDateTime tryTo = dtTo;
-
     // Make sure that we never suggest a date in the past, even if the
     // user originally scheduled the meeting to be in the past.
-    QDateTime now = QDateTime::currentDateTimeUtc();
-    if (tryFrom < now) {
-        // The slot to look for is at least partially in the past.
-        const qint64 secs = tryFrom.secsTo(tryTo);
-        tryFrom = now;
-        tryTo = tryFrom.addSecs(secs);
+    qint64 from = std::max(requested, QDateTime::currentSecsSinceEpoch());
+    const qint64 horizon = dtFrom.addDays(mSearchHorizonDays).toSecsSinceEpoch();
+
+    // Move from to the next time the current attendee is free, until a full
+    // round over all attendees leaves it untouched. Every attendee keeps a
+    // cursor into its index, as from never decreases.
+    QList<qsizetype> cursors(indexes.size(), 0);
+    qsizetype agreed = 0;
+    qsizetype i = 0;
+    while (agreed < indexes.size() && from <= horizon) {
+        const qint64 next = indexes.at(i)->nextFree(from, duration, cursors[i]);
+        if (next == from) {
+            ++agreed;
+        } else {
+            from = next;
+            agreed = 1;
+        }
+        i = (i + 1) % indexes.size();
+    }
+    if (from > horizon) {
+        return KCalendarCore::Period();
+    }
+    const QDateTime freeStart = dtFrom.addSecs(from - requested);
+    return KCalendarCore::Period(freeStart, freeStart.addSecs(duration));
+}
+
+KCalendarCore::Period ConflictResolver::firstFreeSlot(qint64 duration) const
+{
+    const SearchInput input = createSearchInput();
+    const SlotGrid &grid = input.grid;
+    if (duration <= 0 || grid.range <= 0) {
+        return {};
     }
 
-    bool found = false;
-    while (!found) {
-        found = tryDate(tryFrom, tryTo);
-        // PENDING(kalle) Make the interval configurable
-        if (!found && dtFrom.daysTo(tryFrom) > 365) {
-            break; // don't look more than one year in the future
+    // Converts the busy periods chunk by chunk in chronological order, like the progressive
+    // search, and stops at the first gap which is long enough. Once the intervals starting
+    // before the end of a chunk are converted, the gaps before it are final. So only the
+    // periods up to the free slot are looked at, and a busy day costs its periods, not its slots.
+    // The chunks double in size, starting with a day.
+    const qint64 length = (duration + grid.resolution - 1) / grid.resolution;
+    const QList<SlotRun> blocked = slotsStartingIn(constraintIntervals(input), grid.beginSecs, grid.resolution, grid.range);
+    qsizetype nextBlocked = 0;
+    QList<qsizetype> cursors(input.busyIntervals.size(), 0);
+    qint64 freeFrom = 0; // the slots before are busy or too short, the ones after are free up to the next busy run
+    qint64 first = -1;
+    qint64 chunkSlots = std::max(1, 24 * 60 * 60 / grid.resolution);
+    QList<SlotRun> chunkRuns;
+    QList<SlotRun> rowRuns;
+    for (qint64 chunkBegin = 0; chunkBegin < grid.range && first < 0; chunkBegin += chunkSlots, chunkSlots *= 2) {
+        const qint64 chunkEnd = std::min(chunkBegin + chunkSlots, grid.range);
+        // the last chunk takes all remaining intervals, the same as converting the whole grid at once
+        const qint64 untilSecs = chunkEnd == grid.range ? grid.endSecs - grid.beginSecs + 1 : chunkEnd * grid.resolution;
+        chunkRuns.clear();
+        for (int i = 0; i < input.busyIntervals.size(); ++i) {
+            if (input.counted.at(i)) {
+                // converted one row at a time, appendSlotRuns() merges with the last run
+                rowRuns.clear();
+                appendSlotRuns(rowRuns, input.busyIntervals.at(i), grid, cursors[i], untilSecs);
+                chunkRuns << rowRuns;
+            }
         }
+        for (; nextBlocked < blocked.size() && blocked.at(nextBlocked).first < chunkEnd; ++nextBlocked) {
+            chunkRuns << blocked.at(nextBlocked);
+        }
+        std::sort(chunkRuns.begin(), chunkRuns.end(), [](const SlotRun &left, const SlotRun &right) {
+            return left.first < right.first;
+        });
+        for (const SlotRun &run : std::as_const(chunkRuns)) {
+            if (run.first - freeFrom >= length) {
+                first = freeFrom;
+                break;
+            }
+            freeFrom = std::max(freeFrom, run.last);
+        }
+    }
+    if (first < 0 && grid.range - freeFrom >= length) {
+        first = freeFrom;
     }
+    if (first < 0) {
+        return {};
+    }
+    const QDateTime start = grid.begin.addSecs(first * grid.resolution);
+    return KCalendarCore::Period(start, start.addSecs(duration));
+}
 
-    dtFrom = tryFrom;
-    dtTo = tryTo;
+const ConflictResolver::ConflictHistogram &ConflictResolver::conflictHistogram() const
+{
+    return mConflictHistogram;
+}
 
-    return found;
+KCalendarCore::Period::List ConflictResolver::scheduleMeetings(const QList<MeetingRequest> &meetings, int timeBudgetMsecs) const
+{
+    KCalendarCore::Period::List periods(meetings.size());
+
+    // one grid for the whole batch, spanning all windows
+    SearchInput input = createSearchInput();
+    QDateTime begin;
+    qint64 beginSecs = std::numeric_limits<qint64>::max();
+    qint64 endSecs = std::numeric_limits<qint64>::min();
+    for (const MeetingRequest &meeting : meetings) {
+        if (meeting.duration > 0 && meeting.window.start().isValid()) {
+            if (meeting.window.start().toSecsSinceEpoch() < beginSecs) {
+                begin = meeting.window.start();
+                beginSecs = begin.toSecsSinceEpoch();
+            }
+            endSecs = std::max(endSecs, meeting.window.end().toSecsSinceEpoch());
+        }
+    }
+    if (beginSecs >= endSecs) {
+        return periods;
+    }
+    SlotGrid &grid = input.grid;
+    grid.begin = begin;
+    grid.beginSecs = beginSecs;
+    grid.endSecs = endSecs;
+    grid.range = (endSecs - beginSecs) / grid.resolution;
+    const QList<SlotRun> blocked = slotsStartingIn(constraintIntervals(input), grid.beginSecs, grid.resolution, grid.range);
+
+    // the busy slots of every attendee are computed once, however many meetings they attend.
+    // The emails are compared in lower case, like everywhere else
+    QHash<QString, QList<SlotRun>> attendeeRuns;
+    const auto busyRunsOf = [this, &attendeeRuns, &grid](const QString &email) -> const QList<SlotRun> & {
+        auto it = attendeeRuns.find(email);
+        if (it == attendeeRuns.end()) {
+            QList<SlotRun> runs;
+            for (const BusyRow &row : std::as_const(mBusyRows)) {
+                if (row.hasFreeBusy && row.attendee.email().toLower() == email) {
+                    runs << slotRunsForIntervals(row.busyIntervals, grid);
+                }
+            }
+            normalizeRuns(runs);
+            it = attendeeRuns.insert(email, runs);
+        }
+        return *it;
+    };
+
+    struct Meeting {
+        qint64 length = 0; //!< in slots
+        QList<SlotRun> busy; //!< of its attendees and outside its window, sorted and merged
+        QList<qsizetype> sharing; //!< the earlier meetings with a common attendee
+    };
+    QList<Meeting> batch(meetings.size());
+    QList<QSet<QString>> emails(meetings.size());
+    for (qsizetype i = 0; i < meetings.size(); ++i) {
+        const MeetingRequest &request = meetings.at(i);
+        Meeting &meeting = batch[i];
+        if (request.duration <= 0 || !request.window.start().isValid()) {
+            continue;
+        }
+        meeting.length = (request.duration + grid.resolution - 1) / grid.resolution;
+        const qint64 windowFirst = (request.window.start().toSecsSinceEpoch() - beginSecs + grid.resolution - 1) / grid.resolution;
+        const qint64 windowLast = (request.window.end().toSecsSinceEpoch() - beginSecs) / grid.resolution;
+        meeting.busy = blocked;
+        meeting.busy << SlotRun{0, windowFirst} << SlotRun{windowLast, grid.range};
+        for (const KCalendarCore::Attendee &attendee : request.attendees) {
+            const QString email = attendee.email().toLower();
+            emails[i].insert(email);
+            meeting.busy << busyRunsOf(email);
+        }
+        normalizeRuns(meeting.busy);
+        for (qsizetype j = 0; j < i; ++j) {
+            if (emails.at(i).intersects(emails.at(j))) {
+                meeting.sharing << j;
+            }
+        }
+    }
+
+    // the free blocks a meeting fits into, after leaving out the slots of the
+    // earlier meetings it shares an attendee with
+    QList<qint64> starts(meetings.size(), -1);
+    const auto fittingGaps = [&batch, &starts, &grid](qsizetype i) {
+        const Meeting &meeting = batch.at(i);
+        QList<SlotRun> taken;
+        for (qsizetype j : meeting.sharing) {
+            if (starts.at(j) >= 0) {
+                taken << SlotRun{starts.at(j), starts.at(j) + batch.at(j).length};
+            }
+        }
+        normalizeRuns(taken);
+        QList<SlotRun> gaps = complementRuns(unionRuns(meeting.busy, taken), grid.range);
+        gaps.removeIf([&meeting](const SlotRun &gap) {
+            return gap.last - gap.first < meeting.length;
+        });
+        return gaps;
+    };
+
+    // meetings without a duration or a window are left out
+    bool complete = true;
+    for (qsizetype i = 0; i < batch.size(); ++i) {
+        if (batch.at(i).length > 0) {
+            const QList<SlotRun> gaps = fittingGaps(i);
+            starts[i] = gaps.isEmpty() ? -1 : gaps.first().first;
+            complete = complete && starts.at(i) >= 0;
+        }
+    }
+
+    if (!complete && timeBudgetMsecs > 0) {
+        // Backtrack over the later starts of the earlier meetings, until every meeting
+        // has a slot or the time is up; the greedy result is kept otherwise. A start is
+        // only tried if all later meetings sharing an attendee still fit somewhere.
+        QList<QList<qsizetype>> sharedLater(batch.size());
+        for (qsizetype i = 0; i < batch.size(); ++i) {
+            for (qsizetype j : std::as_const(batch.at(i).sharing)) {
+                sharedLater[j] << i;
+            }
+        }
+        QElapsedTimer timer;
+        timer.start();
+        QList<qint64> greedy(meetings.size(), -1);
+        std::swap(greedy, starts);
+        std::function<bool(qsizetype)> assign = [&](qsizetype i) {
+            if (i == batch.size()) {
+                return true;
+            }
+            if (batch.at(i).length <= 0) {
+                return assign(i + 1);
+            }
+            const QList<SlotRun> gaps = fittingGaps(i);
+            for (const SlotRun &gap : gaps) {
+                for (qint64 start = gap.first; start + batch.at(i).length <= gap.last; ++start) {
+                    if (timer.hasExpired(timeBudgetMsecs)) {
+                        return false;
+                    }
+                    starts[i] = start;
+                    const bool othersFit = std::all_of(sharedLater.at(i).cbegin(), sharedLater.at(i).cend(), [&fittingGaps](qsizetype j) {
+                        return !fittingGaps(j).isEmpty();
+                    });
+                    if (othersFit && assign(i + 1)) {
+                        return true;
+                    }
+                }
+            }
+            starts[i] = -1;
+            return false;
+        };
+        if (!assign(0)) {
+            std::swap(greedy, starts);
+        }
+    }
+
+    for (qsizetype i = 0; i < batch.size(); ++i) {
+        if (starts.at(i) >= 0) {
+            const QDateTime start = grid.begin.addSecs(starts.at(i) * grid.resolution);
+            periods[i] = KCalendarCore::Period(start, start.addSecs(meetings.at(i).duration));
+        }
+    }
+    return periods;
 }
 
-void ConflictResolver::findAllFreeSlots()
+QList<ConflictResolver::SlotRun> ConflictResolver::blockedRunsOnGrid(const SearchInput &input)
 {
-    // Uses an O(p*n) (n number of attendees, p timeframe range / timeslot resolution ) algorithm to
-    // locate all free blocks in a given timeframe that match the search constraints.
-    // Does so by:
-    // 1. convert each attendees schedule for the timeframe into a bitarray according to
-    //    the time resolution, where each time slot has a value of 1 = busy, 0 = free.
-    // 2. align the arrays vertically, and sum the columns
-    // 3. the resulting summation indicates # of conflicts at each timeslot
-    // 4. locate contiguous timeslots with a values of 0. these are the free time blocks.
+    // the same busy slots as the slot grid search, taken from the cache if it is up to date
+    QList<SlotRun> busy;
+    if (input.reuseGrid) {
+        busy = busyRuns(input.conflictDeltas);
+    } else {
+        for (int i = 0; i < input.busyIntervals.size(); ++i) {
+            if (input.counted.at(i)) {
+                busy << slotRunsForIntervals(input.busyIntervals.at(i), input.grid);
+            }
+        }
+    }
+    busy << slotsStartingIn(constraintIntervals(input), input.grid.beginSecs, input.grid.resolution, input.grid.range);
+    normalizeRuns(busy);
+    return busy;
+}
 
-    // define these locally for readability
-    const QDateTime begin = mTimeframeConstraint.start();
-    const QDateTime end = mTimeframeConstraint.end();
+QList<ConflictResolver::RoomSlot> ConflictResolver::freeSlotsWithRooms(qint64 minimumDuration) const
+{
+    const SearchInput input = createSearchInput();
+    const SlotGrid &grid = input.grid;
+    if (grid.range <= 0) {
+        return {};
+    }
 
-    // calculate the time resolution
-    // each timeslot in the arrays represents a unit of time
-    // specified here.
-    if (mSlotResolutionSeconds < 1) {
-        // fallback to default, if the user's value is invalid
-        mSlotResolutionSeconds = DEFAULT_RESOLUTION_SECONDS;
+    // the model is only read here, the workers get the free/busy info of the rooms
+    struct Room {
+        KCalendarCore::Attendee attendee;
+        KCalendarCore::FreeBusy::Ptr freeBusy;
+    };
+    QList<Room> rooms;
+    for (int i = 0; i < mRoomModel->rowCount(); ++i) {
+        const QModelIndex index = mRoomModel->index(i);
+        const auto freebusy = mRoomModel->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
+        if (freebusy) {
+            rooms.append({mRoomModel->data(index, CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>(), freebusy});
+        }
     }
+    if (rooms.isEmpty()) {
+        return {};
+    }
+
+    // the attendees are combined once, then every room adds its own busy slots to them
+    const QList<SlotRun> attendeesBusy = blockedRunsOnGrid(input);
+    const qint64 minimumSlots = (minimumDuration + grid.resolution - 1) / grid.resolution;
+    const QList<QList<RoomSlot>> perRoom = QtConcurrent::blockingMapped(rooms, [&attendeesBusy, &grid, minimumSlots](const Room &room) {
+        const QList<SlotRun> roomBusy = slotRunsForIntervals(BusyIntervals(room.freeBusy->busyPeriods()), grid);
+        QList<RoomSlot> slots;
+        const QList<SlotRun> gaps = complementRuns(unionRuns(attendeesBusy, roomBusy), grid.range);
+        for (const SlotRun &gap : gaps) {
+            if (gap.last - gap.first >= std::max<qint64>(minimumSlots, 1)) {
+                const QDateTime freeBeginDateTime = grid.begin.addSecs(gap.first * grid.resolution);
+                slots.append({KCalendarCore::Period(freeBeginDateTime, freeBeginDateTime.addSecs((gap.last - gap.first) * grid.resolution)), room.attendee});
+            }
+        }
+        return slots;
+    });
+
+    QList<RoomSlot> slots;
+    for (const QList<RoomSlot> &roomSlots : perRoom) {
+        slots << roomSlots;
+    }
+    std::stable_sort(slots.begin(), slots.end(), [](const RoomSlot &left, const RoomSlot &right) {
+        return left.period.start() < right.period.start();
+    });
+    return slots;
+}
+
+void ConflictResolver::setSearchHorizon(int days)
+{
+    mSearchHorizonDays = days;
+}
+
+int ConflictResolver::searchHorizon() const
+{
+    return mSearchHorizonDays;
+}
+
+void ConflictResolver::setProgressiveBatchSize(int count)
+{
+    mProgressiveBatchSize = std::max(count, 0);
+}
+
+int ConflictResolver::progressiveBatchSize() const
+{
+    return mProgressiveBatchSize;
+}
+
+ConflictResolver::SearchInput ConflictResolver::createSearchInput() const
+{
+    SearchInput input;
+    input.engine = mFreeSlotEngine;
+    input.weekdays = mWeekdays;
+    input.workingHoursStart = mWorkingHoursStart;
+    input.workingHoursEnd = mWorkingHoursEnd;
+    input.workingHoursTimeZone = mWorkingHoursTimeZone.isValid() ? mWorkingHoursTimeZone : mTimeframeConstraint.start().timeZone();
 
     // calculate the length of the timeframe in terms of the amount of timeslots.
     // Example: 1 week timeframe, with resolution of 15 minutes
     //          1 week = 10080 minutes / 15 = 672 15 min timeslots
     //          So, the array would have a length of 672
-    const int range = begin.secsTo(end) / mSlotResolutionSeconds;
-    if (range <= 0) {
-        qCWarning(INCIDENCEEDITOR_LOG) << "free slot calculation: invalid range. range( " << begin.secsTo(end) << ") / mSlotResolutionSeconds("
-                                       << mSlotResolutionSeconds << ") = " << range;
+    input.grid.begin = mTimeframeConstraint.start();
+    input.grid.beginSecs = mTimeframeStart;
+    input.grid.endSecs = mTimeframeEnd;
+    input.grid.resolution = mSlotResolutionSeconds;
+    input.grid.range = (mTimeframeEnd - mTimeframeStart) / mSlotResolutionSeconds;
+    input.progressiveBatchSize = mProgressiveBatchSize;
+
+    // the cached busy periods are implicitly shared, so this is cheap
+    input.busyIntervals.reserve(mBusyRows.size());
+    input.counted.reserve(mBusyRows.size());
+    for (const BusyRow &row : std::as_const(mBusyRows)) {
+        input.busyIntervals << row.busyIntervals;
+        input.counted << rowCountsOnGrid(row);
+    }
+
+    if (mFreeSlotEngine == SlotGridEngine && mGridValid && mGrid == input.grid) {
+        input.reuseGrid = true;
+        input.conflictDeltas = mConflictDeltas;
+    }
+    return input;
+}
+
+void ConflictResolver::findAllFreeSlots()
+{
+    // Runs synchronously, any search still running on a worker thread is outdated by now
+    // and the one which is scheduled is not needed anymore
+    mCalculateTimer.stop();
+    cancelFreeSlotSearch();
+    SearchInput input = createSearchInput();
+    input.generation = ++mSearchGeneration;
+    installSearchResult(runFreeSlotSearch(input));
+}
+
+void ConflictResolver::startFreeSlotSearch()
+{
+    auto watcher = new QFutureWatcher<SearchResult>(this);
+    // a progressive search reports batches of free slots before the final result
+    connect(watcher, &QFutureWatcherBase::resultReadyAt, this, [this, watcher](int index) {
+        const SearchResult result = watcher->resultAt(index);
+        if (result.partial) {
+            reportFreeSlots(result);
+        } else {
+            installSearchResult(result);
+        }
+    });
+    connect(watcher, &QFutureWatcherBase::finished, watcher, &QObject::deleteLater);
+    cancelFreeSlotSearch();
+    SearchInput input = createSearchInput();
+    input.generation = ++mSearchGeneration;
+    watcher->setFuture(QtConcurrent::run([input](QPromise<SearchResult> &promise) mutable {
+        input.isCanceled = [&promise]() {
+            return promise.isCanceled();
+        };
+        promise.addResult(runFreeSlotSearch(input, [&promise, &input](const KCalendarCore::Period::List &slots) {
+            SearchResult batch;
+            batch.generation = input.generation;
+            batch.partial = true;
+            batch.freeSlots = slots;
+            promise.addResult(batch);
+        }));
+    }));
+    mSearchWatcher = watcher;
+}
+
+void ConflictResolver::cancelFreeSlotSearch()
+{
+    // the result would be dropped anyway, the worker thread stops early instead of finishing it
+    if (mSearchWatcher) {
+        mSearchWatcher->cancel();
+        mSearchWatcher = nullptr;
+    }
+}
+
+void ConflictResolver::reportFreeSlots(const SearchResult &batch)
+{
+    if (batch.generation != mSearchGeneration) {
         return;
     }
+    const bool first = batch.generation != mReportedGeneration;
+    mReportedGeneration = batch.generation;
+    Q_EMIT freeSlotsFound(batch.freeSlots, first);
+}
 
-    qCDebug(INCIDENCEEDITOR_LOG) << "from " << begin << " to " << end << "; mSlotResolutionSeconds = " << mSlotResolutionSeconds << "; range = " << range;
-    // filter out attendees for which we don't have FB data
-    // and which don't match the mandatory role constraint
-    QList<KCalendarCore::FreeBusy::Ptr> filteredFBItems;
-    for (int i = 0; i < mFBModel->rowCount(); ++i) {
-        QModelIndex index = mFBModel->index(i);
-        auto attendee = mFBModel->data(index, CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>();
-        if (!matchesRoleConstraint(attendee)) {
-            continue;
+void ConflictResolver::installSearchResult(const SearchResult &result)
+{
+    if (result.generation != mSearchGeneration) {
+        // newer constraints or free/busy data arrived meanwhile, another search is on its way
+        qCDebug(INCIDENCEEDITOR_LOG) << "dropping outdated free slot search" << result.generation << "current:" << mSearchGeneration;
+        return;
+    }
+    if (!result.searched) {
+        if (!mConflictHistogram.runs.isEmpty()) {
+            mConflictHistogram = ConflictHistogram();
+            Q_EMIT conflictHistogramChanged();
         }
-        auto freebusy = mFBModel->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
-        if (freebusy) {
-            filteredFBItems << freebusy;
+        return;
+    }
+    if (result.gridRebuilt) {
+        // the generation matches, so the rows are still the ones the search was started with
+        Q_ASSERT(result.slotRuns.size() == mBusyRows.size());
+        for (int i = 0; i < mBusyRows.size(); ++i) {
+            mBusyRows[i].slotRuns = result.slotRuns.at(i);
         }
+        mGrid = result.grid;
+        mGridValid = true;
+        mConflictDeltas = result.conflictDeltas;
     }
+    ConflictHistogram histogram;
+    if (!result.histogram.isEmpty()) {
+        histogram.begin = result.grid.begin;
+        histogram.resolution = result.grid.resolution;
+        histogram.slots = result.grid.range;
+        histogram.runs = result.histogram;
+    }
+    mConflictHistogram = histogram;
+    Q_EMIT conflictHistogramChanged();
+    mAvailableSlots = result.freeSlots;
+    if (!mAvailableSlots.isEmpty()) {
+        Q_EMIT freeSlotsAvailable(mAvailableSlots);
+    }
+}
 
-    // now we know the number of attendees we are calculating for
-    const int number_attendees = filteredFBItems.size();
+ConflictResolver::SearchResult ConflictResolver::runFreeSlotSearch(const SearchInput &input,
+                                                                   const std::function<void(const KCalendarCore::Period::List &)> &reportSlots)
+{
+    SearchResult result;
+    result.generation = input.generation;
+    // the result of a canceled search is dropped, it must not carry half built rows
+    const auto canceledResult = [&input]() {
+        SearchResult canceled;
+        canceled.generation = input.generation;
+        return canceled;
+    };
+
+    const int number_attendees = std::count(input.counted.cbegin(), input.counted.cend(), true);
+    switch (input.engine) {
+    case SlotGridEngine:
+        if (input.grid.range <= 0) {
+            qCWarning(INCIDENCEEDITOR_LOG) << "free slot calculation: invalid range. range( " << input.grid.endSecs - input.grid.beginSecs
+                                           << ") / mSlotResolutionSeconds(" << input.grid.resolution << ") = " << input.grid.range;
+            return result;
+        }
+        qCDebug(INCIDENCEEDITOR_LOG) << "from " << input.grid.begin << " to " << input.grid.begin.addSecs(input.grid.endSecs - input.grid.beginSecs)
+                                     << "; mSlotResolutionSeconds = " << input.grid.resolution
+                                     << "; range = " << input.grid.range;
+        break;
+    case IntervalSweepEngine:
+        if (input.grid.beginSecs >= input.grid.endSecs) {
+            qCWarning(INCIDENCEEDITOR_LOG) << "free slot calculation: invalid timeframe" << input.grid.beginSecs << input.grid.endSecs;
+            return result;
+        }
+        break;
+    }
+
+    // attendees without FB data or which don't match the mandatory role constraint are not counted
     if (number_attendees <= 0) {
         qCDebug(INCIDENCEEDITOR_LOG) << "no attendees match search criteria";
-        return;
+        return result;
     }
     qCDebug(INCIDENCEEDITOR_LOG) << "num attendees: " << number_attendees;
-    // this is a 2 dimensional array where the rows are attendees
-    // and the columns are 0 or 1 denoting free or busy respectively.
-    QList<QList<int>> fbTable;
-
-    // Explanation of the following loop:
-    // iterate: through each attendee
-    //   allocate: an array of length <range> and fill it with 0s
-    //   iterate: through each attendee's busy period
-    //     if: the period lies inside our timeframe
-    //     then:
-    //       calculate the array index within the timeframe range of the beginning of the busy period
-    //       fill from that index until the period ends with a 1, representing busy
-    //     fi
-    //   etareti
-    // append the allocated array to <fbTable>
-    // etareti
-    for (const KCalendarCore::FreeBusy::Ptr &currentFB : std::as_const(filteredFBItems)) {
-        Q_ASSERT(currentFB); // sanity check
-        const KCalendarCore::Period::List busyPeriods = currentFB->busyPeriods();
-        QList<int> fbArray(range);
-        fbArray.fill(0); // initialize to zero
-        for (const auto &period : busyPeriods) {
-            if (period.end() >= begin && period.start() <= end) {
-                int start_index = -1; // Initialize it to an invalid value.
-                int duration = -1; // Initialize it to an invalid value.
-                // case1: the period is completely in our timeframe
-                if (period.end() <= end && period.start() >= begin) {
-                    start_index = begin.secsTo(period.start()) / mSlotResolutionSeconds;
-                    duration = period.start().secsTo(period.end()) / mSlotResolutionSeconds;
-                    duration -= 1; // vector starts at 0
-                    // case2: the period begins before our timeframe begins
-                } else if (period.start() <= begin && period.end() <= end) {
-                    start_index = 0;
-                    duration = (begin.secsTo(period.end()) / mSlotResolutionSeconds) - 1;
-                    // case3: the period ends after our timeframe ends
-                } else if (period.end() >= end && period.start() >= begin) {
-                    start_index = begin.secsTo(period.start()) / mSlotResolutionSeconds;
-                    duration = range - start_index - 1;
-                    // case4: case2+case3: our timeframe is inside the period
-                } else if (period.start() <= begin && period.end() >= end) {
-                    start_index = 0;
-                    duration = range - 1;
-                } else {
-                    // QT5
-                    // qCCritical(INCIDENCEEDITOR_LOG) << "impossible condition reached" << period.start() << period.end();
+
+    result.searched = true;
+    result.grid = input.grid;
+    KCalendarCore::Period::List freeSlots;
+    SlotBatchReporter reporter(result.freeSlots, input.progressiveBatchSize, reportSlots);
+    switch (input.engine) {
+    case SlotGridEngine:
+        if (input.reuseGrid) {
+            result.conflictDeltas = input.conflictDeltas;
+        } else if (input.progressiveBatchSize > 0 && reportSlots) {
+            result.gridRebuilt = true;
+            searchGridProgressively(input, result, reporter);
+            if (input.canceled()) {
+                return canceledResult();
+            }
+            reporter.flush();
+            result.histogram = histogramRuns(result.conflictDeltas, input.grid.range);
+            return result;
+        } else {
+            // convert each attendees schedule for the timeframe into runs of busy slots
+            // and sum the runs up into the number of conflicts per timeslot
+            result.gridRebuilt = true;
+            result.slotRuns.reserve(input.busyIntervals.size());
+            for (int i = 0; i < input.busyIntervals.size(); ++i) {
+                if (input.canceled()) {
+                    return canceledResult();
                 }
-                //      qCDebug(INCIDENCEEDITOR_LOG) << start_index << "+" << duration << "="
-                //               << start_index + duration << "<=" << range;
-                Q_ASSERT((start_index + duration) < range); // sanity check
-                for (int i = start_index; i <= start_index + duration; ++i) {
-                    fbArray[i] = 1;
+                const QList<SlotRun> runs = slotRunsForIntervals(input.busyIntervals.at(i), input.grid);
+                if (input.counted.at(i)) {
+                    addSlotRuns(result.conflictDeltas, runs, 1);
                 }
+                result.slotRuns << runs;
             }
         }
-        Q_ASSERT(fbArray.size() == range); // sanity check
-        fbTable.append(fbArray);
-    }
-
-    Q_ASSERT(fbTable.size() == number_attendees);
-
-    // Now, create another array to represent the allowed weekdays constraints
-    // All days which are not allowed, will be marked as busy
-    QList<int> fbArray(range);
-    fbArray.fill(0); // initialize to zero
-    for (int slot = 0; slot < fbArray.size(); ++slot) {
-        const QDateTime dateTime = begin.addSecs(slot * mSlotResolutionSeconds);
-        const int dayOfWeek = dateTime.date().dayOfWeek() - 1; // bitarray is 0 indexed
-        if (!mWeekdays[dayOfWeek]) {
-            fbArray[slot] = 1;
-        }
-    }
-    fbTable.append(fbArray);
-
-    // Create the composite array that will hold the sums for
-    // each 15 minute timeslot
-    QList<int> summed(range);
-    summed.fill(0); // initialize to zero
-
-    // Sum the columns of the table
-    for (int i = 0; i < fbTable.size(); ++i) {
-        for (int j = 0; j < range; ++j) {
-            summed[j] += fbTable[i][j];
-        }
-    }
-
-    // Finally, iterate through the composite array locating contiguous free timeslots
-    int free_count = 0;
-    bool free_found = false;
-    mAvailableSlots.clear();
-    for (int i = 0; i < range; ++i) {
-        // free timeslot encountered, increment counter
-        if (summed[i] == 0) {
-            ++free_count;
-        }
-        if (summed[i] != 0 || (i == (range - 1) && summed[i] == 0)) {
-            // current slot is not free, so push the previous free blocks
-            // OR we are in the last slot and it is free
-            if (free_count > 0) {
-                int free_start_i; // start index of the free block
-                int free_end_i; // end index of the free block
-                if (summed[i] == 0) {
-                    // special case: we are on the last slot and it is free
-                    //               so we want to include this slot in the free block
-                    free_start_i = i - free_count + 1; // add one, to set us back inside the array because
-                    // free_count was incremented already this iteration
-                    free_end_i = i + 1; // add one to compensate for the fact that the array is 0 indexed
-                } else {
-                    free_start_i = i - free_count;
-                    free_end_i = i - 1 + 1; // add one to compensate for the fact that the array is 0 indexed
-                    // compiler will optimize out the -1+1, but I leave it here to make the reasoning apparent.
-                }
-                // convert from our timeslot interval back into to normal seconds
-                // then calculate the date times of the free block based on
-                // our initial timeframe
-                const QDateTime freeBegin = begin.addSecs(free_start_i * mSlotResolutionSeconds);
-                const QDateTime freeEnd = freeBegin.addSecs((free_end_i - free_start_i) * mSlotResolutionSeconds);
-                // push the free block onto the list
-                mAvailableSlots << KCalendarCore::Period(freeBegin, freeEnd);
-                free_count = 0;
-                if (!free_found) {
-                    free_found = true;
-                }
+        freeSlots = freeSlotsOnGrid(result.conflictDeltas, input.grid, constraintIntervals(input));
+        result.histogram = histogramRuns(result.conflictDeltas, input.grid.range);
+        break;
+    case IntervalSweepEngine: {
+        QList<BusyIntervals> busyLists;
+        for (int i = 0; i < input.busyIntervals.size(); ++i) {
+            if (input.counted.at(i)) {
+                busyLists << input.busyIntervals.at(i);
             }
         }
+        // the constrained time is simply one more attendee who is busy
+        busyLists << constraintIntervals(input);
+        freeSlots = freeSlotsBySweep(busyLists, input.grid, input.isCanceled);
+        if (input.canceled()) {
+            return canceledResult();
+        }
+        break;
     }
-    if (free_found) {
-        Q_EMIT freeSlotsAvailable(mAvailableSlots);
     }
-#if 0
-    //DEBUG, dump the arrays. very helpful for debugging
-    QTextStream dump(stdout);
-    dump << "    ";
-    dump.setFieldWidth(3);
-    for (int i = 0; i < range; ++i) {   // header
-        dump << i;
+    // all slots are known at once, they are still reported in the batches of a progressive search
+    result.freeSlots.reserve(freeSlots.size());
+    for (const KCalendarCore::Period &slot : std::as_const(freeSlots)) {
+        reporter.add(slot);
     }
-    dump.setFieldWidth(1);
-    dump << "\n\n";
-    for (int i = 0; i < number_attendees; ++i) {
-        dump.setFieldWidth(1);
-        dump << i << ":  ";
-        dump.setFieldWidth(3);
-        for (int j = 0; j < range; ++j) {
-            dump << fbTable[i][j];
+    reporter.flush();
+    return result;
+}
+
+void ConflictResolver::searchGridProgressively(const SearchInput &input, SearchResult &result, SlotBatchReporter &reporter)
+{
+    // Converts the schedules chunk by chunk, in chronological order. Once the intervals starting
+    // before the end of a chunk are converted, the slots before it are final: a later interval
+    // starts on a later slot. So every free block which ends before is reported right away,
+    // while the free slot search over the whole grid has to wait for all rows.
+    // The chunks double in size, starting with a day.
+    const SlotGrid &grid = input.grid;
+    const QList<SlotRun> blocked = slotsStartingIn(constraintIntervals(input), grid.beginSecs, grid.resolution, grid.range);
+    qsizetype nextBlocked = 0;
+    const int rows = input.busyIntervals.size();
+    result.slotRuns = QList<QList<SlotRun>>(rows);
+    QList<qsizetype> cursors(rows, 0);
+    qint64 freeFrom = 0; // the slots before are decided, the ones after are free up to the next busy run
+    qint64 chunkSlots = std::max(1, 24 * 60 * 60 / grid.resolution);
+    const auto addFreeBlock = [&grid, &reporter](qint64 first, qint64 last) {
+        const QDateTime freeBeginDateTime = grid.begin.addSecs(first * grid.resolution);
+        reporter.add(KCalendarCore::Period(freeBeginDateTime, freeBeginDateTime.addSecs((last - first) * grid.resolution)));
+    };
+    for (qint64 chunkBegin = 0; chunkBegin < grid.range; chunkBegin += chunkSlots, chunkSlots *= 2) {
+        if (input.canceled()) {
+            return;
+        }
+        const qint64 chunkEnd = std::min(chunkBegin + chunkSlots, grid.range);
+        // the last chunk takes all remaining intervals, the same as converting the whole grid at once
+        const qint64 untilSecs = chunkEnd == grid.range ? grid.endSecs - grid.beginSecs + 1 : chunkEnd * grid.resolution;
+        QList<SlotRun> chunkRuns;
+        for (int i = 0; i < rows; ++i) {
+            QList<SlotRun> &runs = result.slotRuns[i];
+            const qsizetype changedFrom = std::max<qsizetype>(runs.size() - 1, 0); // the last run may grow
+            appendSlotRuns(runs, input.busyIntervals.at(i), grid, cursors[i], untilSecs);
+            if (input.counted.at(i)) {
+                chunkRuns << runs.mid(changedFrom);
+            }
+        }
+        for (; nextBlocked < blocked.size() && blocked.at(nextBlocked).first < chunkEnd; ++nextBlocked) {
+            chunkRuns << blocked.at(nextBlocked);
+        }
+        std::sort(chunkRuns.begin(), chunkRuns.end(), [](const SlotRun &left, const SlotRun &right) {
+            return left.first < right.first;
+        });
+        for (const SlotRun &run : std::as_const(chunkRuns)) {
+            if (run.first > freeFrom) {
+                addFreeBlock(freeFrom, run.first);
+            }
+            freeFrom = std::max(freeFrom, run.last);
         }
-        dump << "\n\n";
     }
-    dump.setFieldWidth(1);
-    dump << "    ";
-    dump.setFieldWidth(3);
-    for (int i = 0; i < range; ++i) {
-        dump << summed[i];
+    if (freeFrom < grid.range) {
+        addFreeBlock(freeFrom, grid.range);
+    }
+
+    for (int i = 0; i < rows; ++i) {
+        if (input.counted.at(i)) {
+            addSlotRuns(result.conflictDeltas, result.slotRuns.at(i), 1);
+        }
+    }
+}
+
+KCalendarCore::Period::List ConflictResolver::freeSlotsOnGrid(const QMap<qint64, int> &conflictDeltas, const SlotGrid &grid, const BusyIntervals &blocked)
+{
+    // Uses an O(R log R) (R number of runs of busy slots of all attendees) algorithm to
+    // locate all free blocks in a given timeframe that match the search constraints.
+    // Does so by:
+    // 1. convert each attendees schedule for the timeframe into runs of busy slots according
+    //    to the time resolution. The runs are cached and only rebuilt when the timeframe or
+    //    the resolution changes, or when the free/busy data of that attendee changes.
+    // 2. the cached runs are summed up into the changes of the number of conflicts at the
+    //    run boundaries. When a single row changes, the old runs are subtracted and the new
+    //    ones are added.
+    // 3. the runs with at least one conflict, on a day which is not allowed or outside of the
+    //    working hours are merged (done here)
+    // 4. the gaps between the merged runs are the free time blocks. (done here)
+    // Neither the memory nor the time depend on the number of slots, so even a resolution
+    // of one second over a long timeframe is fine.
+
+    // A slot of a day which is not allowed or outside of the working hours is blocked if it
+    // starts in the blocked time
+    QList<SlotRun> busy = busyRuns(conflictDeltas);
+    busy << slotsStartingIn(blocked, grid.beginSecs, grid.resolution, grid.range);
+    normalizeRuns(busy);
+
+    // Finally, walk through the gaps between the busy runs
+    KCalendarCore::Period::List freeSlots;
+    const QList<SlotRun> gaps = complementRuns(busy, grid.range);
+    freeSlots.reserve(gaps.size());
+    for (const SlotRun &gap : gaps) {
+        // convert from our timeslot interval back into to normal seconds
+        // then calculate the date times of the free block based on
+        // our initial timeframe
+        const QDateTime freeBeginDateTime = grid.begin.addSecs(gap.first * grid.resolution);
+        const QDateTime freeEndDateTime = freeBeginDateTime.addSecs((gap.last - gap.first) * grid.resolution);
+        // push the free block onto the list
+        freeSlots << KCalendarCore::Period(freeBeginDateTime, freeEndDateTime);
+    }
+    return freeSlots;
+}
+
+KCalendarCore::Period::List ConflictResolver::freeSlotsBySweep(QList<BusyIntervals> busyLists, const SlotGrid &grid, const std::function<bool()> &isCanceled)
+{
+    // Uses an O(P log P) (P number of busy periods of all attendees) algorithm to
+    // locate all free blocks in a given timeframe that match the search constraints.
+    // Does so by:
+    // 1. take each attendee's busy intervals, sorted by their start (see BusyIntervals)
+    // 2. merge the sorted lists with a k-way merge, so the intervals are visited
+    //    in ascending order of their start
+    // 3. keep track of the end of the busy block covered so far. each time an
+    //    interval starts after that point, the gap in between is free for everybody.
+    // The days which are not allowed and the time outside of the working hours are
+    // passed in as one more list of busy intervals, see constraintIntervals().
+    // No time slots are involved, so the free blocks are exact.
+
+    // the heap holds one cursor (list, position) per attendee, ordered by the start
+    // of the interval the cursor points to. std::priority_queue is a max heap, hence
+    // the inverted comparison.
+    using Cursor = std::pair<qsizetype, qsizetype>;
+    const auto cursorAfter = [&busyLists](const Cursor &left, const Cursor &right) {
+        return busyLists.at(right.first).at(right.second).start < busyLists.at(left.first).at(left.second).start;
+    };
+    busyLists.removeIf([](const BusyIntervals &intervals) {
+        return intervals.isEmpty();
+    });
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(cursorAfter)> heap(cursorAfter);
+    for (qsizetype i = 0; i < busyLists.size(); ++i) {
+        heap.push({i, 0});
+    }
+
+    const qint64 end = grid.endSecs;
+    QList<BusyIntervals::Interval> freeIntervals;
+    qint64 busyUntil = grid.beginSecs;
+    for (qsizetype visited = 1; !heap.empty() && busyUntil < end; ++visited) {
+        // an outdated search stops, checked now and then as it is cheap but not free
+        if (isCanceled && visited % CANCEL_CHECK_INTERVAL == 0 && isCanceled()) {
+            return {};
+        }
+        const Cursor cursor = heap.top();
+        heap.pop();
+        const BusyIntervals::Interval &interval = busyLists.at(cursor.first).at(cursor.second);
+        if (cursor.second + 1 < busyLists.at(cursor.first).size()) {
+            heap.push({cursor.first, cursor.second + 1});
+        }
+        if (interval.start > busyUntil) {
+            freeIntervals.append({busyUntil, std::min(interval.start, end)});
+        }
+        busyUntil = std::max(busyUntil, interval.end);
+    }
+    if (busyUntil < end) {
+        freeIntervals.append({busyUntil, end});
+    }
+
+    // Only here, at the output, the seconds are converted back into date times
+    KCalendarCore::Period::List freeSlots;
+    freeSlots.reserve(freeIntervals.size());
+    for (const BusyIntervals::Interval &freeInterval : std::as_const(freeIntervals)) {
+        freeSlots << KCalendarCore::Period(grid.begin.addSecs(freeInterval.start - grid.beginSecs), grid.begin.addSecs(freeInterval.end - grid.beginSecs));
+    }
+    return freeSlots;
+}
+
+BusyIntervals ConflictResolver::constraintIntervals(const SearchInput &input)
+{
+    // Walk the days of the timeframe once, instead of doing the date math for every slot
+    QList<BusyIntervals::Interval> blocked;
+    const auto addDays = [&input](const QTimeZone &timeZone, const auto &blockDay) {
+        const QDate firstDate = QDateTime::fromSecsSinceEpoch(input.grid.beginSecs, timeZone).date();
+        const QDate lastDate = QDateTime::fromSecsSinceEpoch(input.grid.endSecs, timeZone).date();
+        qint64 dayStart = firstDate.startOfDay(timeZone).toSecsSinceEpoch();
+        for (QDate date = firstDate; date <= lastDate; date = date.addDays(1)) {
+            const qint64 dayEnd = date.addDays(1).startOfDay(timeZone).toSecsSinceEpoch();
+            blockDay(date, dayStart, dayEnd);
+            dayStart = dayEnd;
+        }
+    };
+
+    // the weekdays are those of the timeframe
+    addDays(input.grid.begin.timeZone(), [&input, &blocked](QDate date, qint64 dayStart, qint64 dayEnd) {
+        if (!input.weekdays.testBit(date.dayOfWeek() - 1)) { // bitarray is 0 indexed
+            blocked.append({dayStart, dayEnd});
+        }
+    });
+
+    if (input.workingHoursStart.isValid() && input.workingHoursEnd.isValid()) {
+        const QTimeZone &timeZone = input.workingHoursTimeZone;
+        addDays(timeZone, [&input, &blocked, &timeZone](QDate date, qint64 dayStart, qint64 dayEnd) {
+            blocked.append({dayStart, QDateTime(date, input.workingHoursStart, timeZone).toSecsSinceEpoch()});
+            blocked.append({QDateTime(date, input.workingHoursEnd, timeZone).toSecsSinceEpoch(), dayEnd});
+        });
     }
-    dump << "\n";
-#endif
+    return BusyIntervals(blocked);
 }
 
 void ConflictResolver::calculateConflicts()
 {
-    QDateTime start = mTimeframeConstraint.start();
-    QDateTime end = mTimeframeConstraint.end();
-    const int count = tryDate(start, end);
-    Q_EMIT conflictsDetected(count);
+    // The timeframe or the role constraint changed, so every row has to be checked again.
+    // The free/busy data itself is taken from the cache.
+    mConflictCount = 0;
+    for (BusyRow &row : mBusyRows) {
+        row.conflicts = rowConflicts(row);
+        mConflictCount += row.conflicts ? 1 : 0;
+    }
+    publishConflicts();
+}
+
+void ConflictResolver::beginConstraintsUpdate()
+{
+    ++mConstraintsUpdateDepth;
+}
 
+void ConflictResolver::endConstraintsUpdate()
+{
+    Q_ASSERT(mConstraintsUpdateDepth > 0);
+    if (--mConstraintsUpdateDepth == 0 && mConstraintsChanged) {
+        mConstraintsChanged = false;
+        calculateConflicts();
+    }
+}
+
+void ConflictResolver::constraintsChanged()
+{
+    if (mConstraintsUpdateDepth > 0) {
+        mConstraintsChanged = true;
+        return;
+    }
+    calculateConflicts();
+}
+
+void ConflictResolver::publishConflicts()
+{
+    Q_EMIT conflictsDetected(mConflictCount);
+
+    // outdate any search which is still running
+    ++mSearchGeneration;
+    cancelFreeSlotSearch();
     if (!mCalculateTimer.isActive()) {
         mCalculateTimer.start(0);
     }
@@ -441,16 +1499,336 @@ void ConflictResolver::calculateConflicts()
 void ConflictResolver::setAllowedWeekdays(const QBitArray &weekdays)
 {
     mWeekdays = weekdays;
-    calculateConflicts();
+    constraintsChanged();
+}
+
+QList<ConflictResolver::RankedSlot> ConflictResolver::rankedSlots(qint64 duration, int count) const
+{
+    const SearchInput input = createSearchInput();
+    const SlotGrid &grid = input.grid;
+    if (duration <= 0 || count <= 0 || grid.range <= 0) {
+        return {};
+    }
+    // a window is a candidate slot, window s covers the slots [s, s + windowSlots)
+    const qint64 windowSlots = (duration + grid.resolution - 1) / grid.resolution;
+    const qint64 windows = grid.range - windowSlots + 1;
+    if (windows <= 0) {
+        return {};
+    }
+
+    // A busy run covering the slots [first, last) conflicts with the windows
+    // (first - windowSlots, last). Instead of summing up every window, the weight
+    // is added where that range of windows begins and subtracted where it ends,
+    // so a single sweep over the boundaries yields the runs of windows with the
+    // same conflicts, without touching every window.
+    // The blocked runs are merged after widening them.
+    const auto forEachConflictRange = [&grid, windowSlots, windows](const BusyIntervals &intervals, const auto &addRange) {
+        qint64 rangeBegin = 0;
+        qint64 rangeEnd = 0;
+        for (qsizetype i = 0; i < intervals.size(); ++i) {
+            const qint64 start = intervals.at(i).start - grid.beginSecs;
+            const qint64 end = intervals.at(i).end - grid.beginSecs;
+            if (end <= 0) {
+                continue;
+            }
+            const qint64 first = std::max<qint64>(start / grid.resolution - windowSlots + 1, 0);
+            const qint64 last = std::min<qint64>((end + grid.resolution - 1) / grid.resolution, windows);
+            if (first >= windows) {
+                break; // the intervals are sorted, none of the remaining ones is in the timeframe
+            }
+            if (first <= rangeEnd && rangeBegin < rangeEnd) {
+                rangeEnd = std::max(rangeEnd, last);
+                continue;
+            }
+            if (rangeBegin < rangeEnd) {
+                addRange(rangeBegin, rangeEnd);
+            }
+            rangeBegin = first;
+            rangeEnd = last;
+        }
+        if (rangeBegin < rangeEnd) {
+            addRange(rangeBegin, rangeEnd);
+        }
+    };
+
+    // The weights are kept in hundredths, the product of the role weight and the status weight
+    struct Delta {
+        int weight = 0;
+        int attendees = 0;
+        int blocked = 0;
+    };
+    QMap<qint64, Delta> deltas;
+    struct WeightedRange {
+        qint64 first;
+        qint64 last;
+        int weight;
+    };
+    QList<WeightedRange> ranges;
+    for (const BusyRow &row : mBusyRows) {
+        const int weight = roleWeight(row.attendee.role());
+        if (!row.hasFreeBusy || weight <= 0) {
+            continue;
+        }
+        // the widened ranges of all busy periods of the attendee, whatever their status
+        ranges.clear();
+        for (const StatusInterval &interval : row.statusIntervals) {
+            const qint64 start = interval.start - grid.beginSecs;
+            const qint64 end = interval.end - grid.beginSecs;
+            const int rangeWeight = weight * statusWeight(interval.type);
+            if (end <= 0 || rangeWeight <= 0) {
+                continue;
+            }
+            const qint64 first = std::max<qint64>(start / grid.resolution - windowSlots + 1, 0);
+            const qint64 last = std::min<qint64>((end + grid.resolution - 1) / grid.resolution, windows);
+            if (first >= windows) {
+                break; // the intervals are sorted, none of the remaining ones is in the timeframe
+            }
+            ranges.append({first, last, rangeWeight});
+        }
+
+        // One sweep over the ranges yields the heaviest status of the attendee in each window,
+        // so an attendee who is busy several times during a window is only counted once.
+        std::priority_queue<std::pair<int, qint64>> active; // weight and end of the ranges covering pos
+        qsizetype next = 0;
+        qint64 pos = 0;
+        while (next < ranges.size() || !active.empty()) {
+            if (active.empty()) {
+                pos = std::max(pos, ranges.at(next).first);
+            }
+            for (; next < ranges.size() && ranges.at(next).first <= pos; ++next) {
+                active.emplace(ranges.at(next).weight, ranges.at(next).last);
+            }
+            while (!active.empty() && active.top().second <= pos) {
+                active.pop();
+            }
+            if (active.empty()) {
+                continue;
+            }
+            // the heaviest range decides until it ends or another range begins
+            qint64 segmentEnd = active.top().second;
+            if (next < ranges.size()) {
+                segmentEnd = std::min(segmentEnd, ranges.at(next).first);
+            }
+            deltas[pos].weight += active.top().first;
+            deltas[segmentEnd].weight -= active.top().first;
+            ++deltas[pos].attendees;
+            --deltas[segmentEnd].attendees;
+            pos = segmentEnd;
+        }
+    }
+    forEachConflictRange(constraintIntervals(input), [&deltas](qint64 first, qint64 last) {
+        ++deltas[first].blocked;
+        --deltas[last].blocked;
+    });
+
+    // the runs of windows [first, last) with the same conflicts
+    struct Candidate {
+        qint64 first;
+        qint64 last;
+        int weight;
+        int attendees;
+    };
+    QList<Candidate> candidates;
+    Delta current;
+    auto it = deltas.cbegin();
+    qint64 from = 0;
+    while (from < windows) {
+        for (; it != deltas.cend() && it.key() <= from; ++it) {
+            current.weight += it->weight;
+            current.attendees += it->attendees;
+            current.blocked += it->blocked;
+        }
+        const qint64 to = it != deltas.cend() ? std::min(it.key(), windows) : windows;
+        if (current.blocked == 0) {
+            candidates.append({from, to, current.weight, current.attendees});
+        }
+        from = to;
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &left, const Candidate &right) {
+        return left.weight < right.weight;
+    });
+
+    // take the best windows which don't overlap one already taken, the earliest first
+    QList<RankedSlot> slots;
+    QList<qint64> taken;
+    for (const Candidate &candidate : std::as_const(candidates)) {
+        qint64 window = candidate.first;
+        while (window < candidate.last && slots.size() < count) {
+            qint64 next = window;
+            for (const qint64 other : std::as_const(taken)) {
+                if (std::abs(other - window) < windowSlots) {
+                    next = std::max(next, other + windowSlots);
+                }
+            }
+            if (next != window) {
+                window = next;
+                continue;
+            }
+            taken.append(window);
+            const QDateTime start = grid.begin.addSecs(window * grid.resolution);
+            slots.append({KCalendarCore::Period(start, start.addSecs(duration)), candidate.weight / 100.0, candidate.attendees});
+            window += windowSlots;
+        }
+        if (slots.size() == count) {
+            break;
+        }
+    }
+    return slots;
+}
+
+KCalendarCore::Period::List
+ConflictResolver::recurringFreeSlots(const KCalendarCore::Recurrence &recurrence, qint64 duration, int occurrences, double fraction) const
+{
+    const SearchInput input = createSearchInput();
+    if (duration <= 0 || occurrences <= 0 || input.grid.range <= 0) {
+        return {};
+    }
+
+    // the distance of each occurrence to the first one, in slots
+    QList<qint64> offsets;
+    offsets.reserve(occurrences);
+    const QDateTime first = recurrence.getNextDateTime(recurrence.startDateTime().addSecs(-1));
+    for (QDateTime occurrence = first; occurrence.isValid() && offsets.size() < occurrences; occurrence = recurrence.getNextDateTime(occurrence)) {
+        offsets << first.secsTo(occurrence) / input.grid.resolution;
+    }
+    if (offsets.isEmpty()) {
+        return {};
+    }
+    const int required = std::max(1, int(std::ceil(fraction * offsets.size())));
+
+    const qint64 windowSlots = (duration + input.grid.resolution - 1) / input.grid.resolution;
+    const qint64 starts = input.grid.range - windowSlots + 1;
+    if (starts <= 0) {
+        return {};
+    }
+
+    // the free runs of a grid spanning the timeframe and all its later occurrences
+    SlotGrid extended = input.grid;
+    extended.range = input.grid.range + offsets.constLast();
+    extended.endSecs = extended.beginSecs + extended.range * extended.resolution;
+    QList<SlotRun> busy;
+    for (int i = 0; i < input.busyIntervals.size(); ++i) {
+        if (input.counted.at(i)) {
+            busy << slotRunsForIntervals(input.busyIntervals.at(i), extended);
+        }
+    }
+    normalizeRuns(busy);
+    const QList<SlotRun> gaps = complementRuns(busy, extended.range);
+
+    // Count for every start in how many occurrences the window is free. A gap [g0, g1)
+    // fits the window of an occurrence at offset o for the starts [g0 - o, g1 - L - o],
+    // so each gap adds one range of starts instead of checking every start.
+    QMap<qint64, int> freeOccurrences;
+    for (const qint64 offset : std::as_const(offsets)) {
+        for (const SlotRun &gap : gaps) {
+            const qint64 from = std::max<qint64>(gap.first - offset, 0);
+            const qint64 to = std::min<qint64>(gap.last - windowSlots - offset + 1, starts);
+            if (from < to) {
+                ++freeOccurrences[from];
+                --freeOccurrences[to];
+            }
+        }
+    }
+    QList<SlotRun> qualified;
+    int count = 0;
+    qint64 qualifiedBegin = 0;
+    for (auto it = freeOccurrences.cbegin(); it != freeOccurrences.cend(); ++it) {
+        const int previous = count;
+        count += it.value();
+        if (previous < required && count >= required) {
+            qualifiedBegin = it.key();
+        } else if (previous >= required && count < required) {
+            qualified.append({qualifiedBegin, it.key()});
+        }
+    }
+
+    // the first occurrence has to respect the weekdays and the working hours,
+    // a window starting at s is blocked if any of its slots [s, s + L) is
+    QList<SlotRun> blockedStarts = slotsStartingIn(constraintIntervals(input), input.grid.beginSecs, input.grid.resolution, input.grid.range);
+    for (SlotRun &run : blockedStarts) {
+        run.first -= windowSlots - 1;
+    }
+    normalizeRuns(blockedStarts);
+    const QList<SlotRun> allowed = complementRuns(blockedStarts, starts);
+
+    // intersect both, each block fits the meeting at any of its starts
+    KCalendarCore::Period::List freeSlots;
+    qsizetype a = 0;
+    qsizetype q = 0;
+    while (a < allowed.size() && q < qualified.size()) {
+        const qint64 blockFirst = std::max(allowed.at(a).first, qualified.at(q).first);
+        const qint64 blockLast = std::min(allowed.at(a).last, qualified.at(q).last);
+        if (blockFirst < blockLast) {
+            const QDateTime blockBegin = input.grid.begin.addSecs(blockFirst * input.grid.resolution);
+            freeSlots << KCalendarCore::Period(blockBegin, blockBegin.addSecs((blockLast - 1 - blockFirst + windowSlots) * input.grid.resolution));
+        }
+        if (allowed.at(a).last < qualified.at(q).last) {
+            ++a;
+        } else {
+            ++q;
+        }
+    }
+    return freeSlots;
+}
+
+void ConflictResolver::setRoleWeight(KCalendarCore::Attendee::Role role, int weight)
+{
+    mRoleWeights.insert(role, weight);
+}
+
+int ConflictResolver::roleWeight(KCalendarCore::Attendee::Role role) const
+{
+    return mRoleWeights.value(role, 0);
+}
+
+void ConflictResolver::setStatusWeight(KCalendarCore::FreeBusyPeriod::FreeBusyType type, int percent)
+{
+    mStatusWeights.insert(type, percent);
+}
+
+int ConflictResolver::statusWeight(KCalendarCore::FreeBusyPeriod::FreeBusyType type) const
+{
+    return mStatusWeights.value(type, 100);
+}
+
+void ConflictResolver::setWorkingHours(QTime start, QTime end, const QTimeZone &timeZone)
+{
+    if (start >= end) {
+        qCWarning(INCIDENCEEDITOR_LOG) << "invalid working hours" << start << end;
+        return;
+    }
+    mWorkingHoursStart = start;
+    mWorkingHoursEnd = end;
+    mWorkingHoursTimeZone = timeZone;
+    constraintsChanged();
+}
+
+void ConflictResolver::clearWorkingHours()
+{
+    mWorkingHoursStart = QTime();
+    mWorkingHoursEnd = QTime();
+    mWorkingHoursTimeZone = QTimeZone();
+    constraintsChanged();
 }
 
 void ConflictResolver::setMandatoryRoles(const QSet<KCalendarCore::Attendee::Role> &roles)
 {
     mMandatoryRoles = roles;
-    calculateConflicts();
+    // the attendees which became mandatory move forward in the fetch queue
+    FreeBusyCache *cache = FreeBusyCache::self();
+    for (const BusyRow &row : std::as_const(mBusyRows)) {
+        if (matchesRoleConstraint(row.attendee) && cache->isFetching(row.attendee.email())) {
+            cache->request(row.attendee.email(), mParentWidget, FreeBusyCache::HighFetchPriority);
+        }
+    }
+    if (mGridValid) {
+        // the cached rows stay valid, only the set of rows counted changes
+        rebuildSlotConflicts();
+    }
+    constraintsChanged();
 }
 
-bool ConflictResolver::matchesRoleConstraint(const KCalendarCore::Attendee &attendee)
+bool ConflictResolver::matchesRoleConstraint(const KCalendarCore::Attendee &attendee) const
 {
     return mMandatoryRoles.contains(attendee.role());
 }
@@ -462,7 +1840,15 @@ KCalendarCore::Period::List ConflictResolver::availableSlots() const
 
 void ConflictResolver::setResolution(int seconds)
 {
+    // calculate the time resolution
+    // each timeslot in the arrays represents a unit of time
+    // specified here.
+    if (seconds < 1) {
+        // fallback to default, if the user's value is invalid
+        seconds = DEFAULT_RESOLUTION_SECONDS;
+    }
     mSlotResolutionSeconds = seconds;
+    constraintsChanged();
 }
 
 CalendarSupport::FreeBusyItemModel *ConflictResolver::model() const
@@ -470,4 +1856,9 @@ CalendarSupport::FreeBusyItemModel *ConflictResolver::model() const
     return mFBModel;
 }
 
+CalendarSupport::FreeBusyItemModel *ConflictResolver::roomModel() const
+{
+    return mRoomModel;
+}
+
 #include "moc_conflictresolver.cpp"
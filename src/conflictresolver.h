@@ -9,13 +9,26 @@
 
 #pragma once
 
+#include "busyintervals.h"
 #include "incidenceeditor_export.h"
 #include <CalendarSupport/FreeBusyItem>
 
+#include <KCalendarCore/FreeBusyPeriod>
+#include <KCalendarCore/Recurrence>
+
 #include <QBitArray>
+#include <QHash>
+#include <QMap>
+#include <QModelIndex>
+#include <QPointer>
 #include <QSet>
+#include <QTimeZone>
 #include <QTimer>
 
+#include <functional>
+
+class QFutureWatcherBase;
+
 namespace CalendarSupport
 {
 class FreeBusyItemModel;
@@ -23,6 +36,8 @@ class FreeBusyItemModel;
 
 namespace IncidenceEditorNG
 {
+class FreeBusyAttendeeModel;
+
 /**
  * Takes a list of attendees and event info (e.g., min time start, max time end)
  * fetches their freebusy information, then identifies conflicts and periods of non-conflict.
@@ -35,6 +50,72 @@ class INCIDENCEEDITOR_EXPORT ConflictResolver : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * The algorithms findAllFreeSlots() can use to locate the free slots.
+     */
+    enum FreeSlotEngine {
+        SlotGridEngine, ///< Quantizes the busy periods onto the slot grid, see setResolution()
+        IntervalSweepEngine, ///< Merges the exact busy periods, independent of the slot resolution
+    };
+    Q_ENUM(FreeSlotEngine)
+
+    /**
+     * A candidate slot returned by rankedSlots().
+     */
+    struct RankedSlot {
+        KCalendarCore::Period period;
+        double weightedConflicts = 0; //!< the sum of the role weights of the conflicting attendees, scaled by their status weights
+        int conflictingAttendees = 0;
+    };
+
+    /**
+     * A run of consecutive slots [first, last) of the slot grid, see setResolution().
+     */
+    struct SlotRun {
+        qint64 first = 0;
+        qint64 last = 0; //!< one past the last slot of the run
+    };
+
+    /**
+     * The number of busy mandatory attendees in each slot of the grid, run-length encoded.
+     * The runs cover all slots in order, two consecutive runs never have the same count.
+     * @see conflictHistogram
+     */
+    struct ConflictHistogram {
+        struct Run {
+            qint64 first = 0;
+            qint64 last = 0; //!< one past the last slot of the run
+            int busyAttendees = 0;
+        };
+
+        QDateTime begin; //!< the start of slot 0
+        int resolution = 0; //!< the length of a slot in seconds
+        qint64 slots = 0;
+        QList<Run> runs;
+
+        [[nodiscard]] QDateTime slotStart(qint64 slot) const
+        {
+            return begin.addSecs(slot * resolution);
+        }
+    };
+
+    /**
+     * A free block returned by freeSlotsWithRooms(), with the room which is free as well.
+     */
+    struct RoomSlot {
+        KCalendarCore::Period period;
+        KCalendarCore::Attendee room;
+    };
+
+    /**
+     * One meeting of a batch, see scheduleMeetings().
+     */
+    struct MeetingRequest {
+        KCalendarCore::Attendee::List attendees; //!< matched by email against the inserted attendees
+        qint64 duration = 0; //!< in seconds
+        KCalendarCore::Period window; //!< the meeting has to take place within it
+    };
+
     /**
      * @param parentWidget is passed to Akonadi when fetching free/busy data.
      */
@@ -61,11 +142,40 @@ public:
      */
     void clearAttendees();
 
+    /**
+     * Makes the attendees of the resolver match @p attendees, by email. Attendees with
+     * a new email are inserted and those whose email is gone are removed. The others
+     * are updated in place, e.g. with a new name or role, so they keep their row and
+     * their free/busy info.
+     * Attendees without an email are ignored.
+     */
+    void setAttendees(const KCalendarCore::Attendee::List &attendees);
+
+    /**
+     * Returns whether the attendee in row @p row of model() is busy at some time from
+     * @p start up to and including @p end. Attendees without free/busy info are free.
+     * The cached busy intervals of the attendee are searched, so this takes O(log n).
+     */
+    [[nodiscard]] bool isBusy(int row, const QDateTime &start, const QDateTime &end) const;
+
     /**
      * Returns whether the resolver contains the attendee
      */
     [[nodiscard]] bool containsAttendee(const KCalendarCore::Attendee &attendee);
 
+    /**
+     * Adds a candidate room for freeSlotsWithRooms(), e.g. a resource found in the LDAP
+     * directory, see ResourceItem::attendee(). Its free/busy info is fetched like the one
+     * of an attendee, but it is not taken into account by the other searches.
+     */
+    void insertRoom(const KCalendarCore::Attendee &room);
+    void insertRoom(const CalendarSupport::FreeBusyItem::Ptr &freebusy);
+
+    /**
+     * Removes all candidate rooms.
+     */
+    void clearRooms();
+
     /**
      * Constrain the free time slot search to the weekdays
      * identified by their KCalendarSystem integer representation
@@ -75,6 +185,23 @@ public:
      */
     void setAllowedWeekdays(const QBitArray &weekdays);
 
+    /**
+     * Constrain the free time slot search to the working hours of each day,
+     * e.g. 09:00 to 17:00. The time outside of the working hours is treated
+     * like a day which is not allowed.
+     * Default is no working hours constraint.
+     * @param start the begin of the working hours
+     * @param end the end of the working hours, has to be after @p start
+     * @param timeZone the time zone of the working hours, e.g. the one of the organizer.
+     * If invalid, the time zone of the timeframe is used.
+     */
+    void setWorkingHours(QTime start, QTime end, const QTimeZone &timeZone = QTimeZone());
+
+    /**
+     * Removes the working hours constraint.
+     */
+    void clearWorkingHours();
+
     /**
      * Constrain the free time slot search to the set participant roles.
      * Mandatory roles are considered the minimum required to attend
@@ -85,6 +212,15 @@ public:
      */
     void setMandatoryRoles(const QSet<KCalendarCore::Attendee::Role> &roles);
 
+    /**
+     * Groups several changes of the constraints, e.g. of the timeframe and the
+     * allowed weekdays. The conflicts are only counted again and a single free
+     * slot search is scheduled by the matching endConstraintsUpdate().
+     * Calls can be nested, only the outermost endConstraintsUpdate() recomputes.
+     */
+    void beginConstraintsUpdate();
+    void endConstraintsUpdate();
+
     /**
      * Returns a list of date time ranges that conform to the
      * search constraints.
@@ -99,8 +235,144 @@ public:
     */
     [[nodiscard]] bool findFreeSlot(const KCalendarCore::Period &dateTimeRange);
 
+    /**
+     * Returns the earliest slot of the same size as @p dateTimeRange, starting at or
+     * after it, during which all mandatory attendees are free. The slot is never
+     * moved into the past, unless @p dateTimeRange itself is free.
+     * Returns an invalid Period if there is no such slot within the search horizon.
+     * @see setSearchHorizon
+     */
+    [[nodiscard]] KCalendarCore::Period nextFreeSlot(const KCalendarCore::Period &dateTimeRange) const;
+
+    /**
+     * Returns the earliest slot of @p duration seconds within the timeframe, starting at the
+     * begin of a slot of the grid, during which all mandatory attendees are free, on an
+     * allowed weekday and within the working hours. Unlike availableSlots() it doesn't need
+     * a free slot search and only looks at the part of the timeframe it has to, so it is
+     * fast even for a timeframe of months at a fine resolution.
+     * Returns an invalid Period if there is no such slot.
+     * @see setResolution
+     */
+    [[nodiscard]] KCalendarCore::Period firstFreeSlot(qint64 duration) const;
+
+    /**
+     * Returns the number of busy mandatory attendees per slot, as found by the last free
+     * slot search, e.g. to draw a heatmap of the conflicts. The reference stays valid
+     * until conflictHistogramChanged() is emitted, the histogram is never copied.
+     * Only the slot grid engine fills it, it is empty for the other engines.
+     * @see setFreeSlotEngine
+     */
+    [[nodiscard]] const ConflictHistogram &conflictHistogram() const;
+
+    /**
+     * Returns the free blocks of the timeframe in which all mandatory attendees and one
+     * of the candidate rooms are free, at least @p minimumDuration seconds long, on allowed
+     * weekdays and within the working hours. A block is returned once for each room which
+     * is free during it, ordered by start and then by the order of the rooms.
+     * The busy slots of the attendees are combined once and each room is added to them on
+     * its own, the rooms are evaluated in parallel. Rooms without free/busy info are skipped.
+     * @see insertRoom
+     */
+    [[nodiscard]] QList<RoomSlot> freeSlotsWithRooms(qint64 minimumDuration = 0) const;
+
+    /**
+     * Schedules a batch of meetings at once, e.g. the interviews of an interview loop.
+     * Every meeting gets the earliest slot within its window in which its attendees are free,
+     * on allowed weekdays and within the working hours, in the order of @p meetings. Meetings
+     * sharing an attendee don't overlap each other. The attendees have to be inserted before,
+     * their busy slots are computed once for the whole batch.
+     *
+     * If the greedy assignment leaves meetings without a slot and @p timeBudgetMsecs is
+     * positive, moving earlier meetings to later slots is tried for at most that long.
+     *
+     * @return the slot of each meeting, in the order of @p meetings, or an invalid period
+     *         for a meeting which could not be scheduled.
+     */
+    [[nodiscard]] KCalendarCore::Period::List scheduleMeetings(const QList<MeetingRequest> &meetings, int timeBudgetMsecs = 0) const;
+
+    /**
+     * Limits how far findFreeSlot() looks into the future.
+     * Default is 365 days.
+     * @param days the maximum number of days between the initial slot and the free slot
+     */
+    void setSearchHorizon(int days);
+    [[nodiscard]] int searchHorizon() const;
+
+    /**
+     * Makes the free slot searches on the worker thread report their results progressively
+     * through freeSlotsFound(): the earliest @p count free slots as soon as they are known,
+     * then the remaining ones in batches, each twice as large as the one before.
+     * freeSlotsAvailable() still reports the whole list once the search is done.
+     * Default is 0, which disables the progressive results.
+     */
+    void setProgressiveBatchSize(int count);
+    [[nodiscard]] int progressiveBatchSize() const;
+
+    /**
+     * Returns up to @p count non-overlapping slots of @p duration seconds within
+     * the timeframe, with the fewest conflicts first. Unlike the free slot search,
+     * slots where some attendees are busy are returned as well, ranked by the
+     * sum of the role weights of the busy attendees, each scaled by the status weight
+     * of its busiest period during the slot. Slots starting at the same
+     * time as a slot of the grid, on allowed weekdays and within the working hours
+     * are considered. Ties are broken by the earlier start.
+     * The mandatory roles are not taken into account, use setRoleWeight() instead.
+     * @see setResolution
+     */
+    [[nodiscard]] QList<RankedSlot> rankedSlots(qint64 duration, int count) const;
+
+    /**
+     * Returns the blocks of the timeframe in which a recurring meeting of @p duration
+     * seconds can start, so that it is free for all mandatory attendees in at least
+     * @p fraction of its next @p occurrences occurrences.
+     *
+     * The occurrences are taken from @p recurrence, starting with its first one, and are
+     * moved along with the start in the timeframe. E.g. for a weekly recurrence a start
+     * on Tuesday 10:00 is checked on the Tuesdays 10:00 of the following weeks.
+     * The weekday and working hours constraints apply to the first occurrence.
+     * The distances between the occurrences are rounded down to the slot resolution.
+     * @see setResolution
+     */
+    [[nodiscard]] KCalendarCore::Period::List
+    recurringFreeSlots(const KCalendarCore::Recurrence &recurrence, qint64 duration, int occurrences, double fraction = 1.0) const;
+
+    /**
+     * Sets how much a conflict with an attendee of @p role weighs in rankedSlots().
+     * Attendees with a weight of 0 are ignored.
+     * Defaults are 2 for chairs and required participants, 1 for optional
+     * participants and 0 for non-participants.
+     */
+    void setRoleWeight(KCalendarCore::Attendee::Role role, int weight);
+    [[nodiscard]] int roleWeight(KCalendarCore::Attendee::Role role) const;
+
+    /**
+     * Sets how much a busy period of status @p type counts in rankedSlots(), in percent
+     * of the role weight of the attendee.
+     * Defaults are 100 for busy, unavailable and unknown periods, 50 for tentative
+     * periods, which makes them soft conflicts, and 0 for free periods.
+     * The free slot search treats all periods as busy, whatever their status.
+     */
+    void setStatusWeight(KCalendarCore::FreeBusyPeriod::FreeBusyType type, int percent);
+    [[nodiscard]] int statusWeight(KCalendarCore::FreeBusyPeriod::FreeBusyType type) const;
+
+    /**
+     * Selects the algorithm used by findAllFreeSlots().
+     * SlotGridEngine costs O(timeframe / resolution * attendees), the
+     * IntervalSweepEngine costs O(P log P) of the number of busy periods
+     * and returns free slots which are not rounded to the slot resolution.
+     * Default is SlotGridEngine.
+     */
+    void setFreeSlotEngine(FreeSlotEngine engine);
+    [[nodiscard]] FreeSlotEngine freeSlotEngine() const;
+
     CalendarSupport::FreeBusyItemModel *model() const;
 
+    /**
+     * The candidate rooms, with their free/busy info.
+     * @see insertRoom
+     */
+    CalendarSupport::FreeBusyItemModel *roomModel() const;
+
 Q_SIGNALS:
     /**
      * Emitted when the user changes the start and end dateTimes
@@ -119,6 +391,19 @@ Q_SIGNALS:
      */
     void freeSlotsAvailable(const KCalendarCore::Period::List &);
 
+    /**
+     * Emitted by a progressive free slot search with the next free slots, in chronological order.
+     * @param first whether these are the first slots of a new search, replacing the ones before
+     * @see setProgressiveBatchSize
+     */
+    void freeSlotsFound(const KCalendarCore::Period::List &slots, bool first);
+
+    /**
+     * Emitted when a free slot search replaced the conflict histogram.
+     * @see conflictHistogram
+     */
+    void conflictHistogramChanged();
+
 public Q_SLOTS:
     /**
      * Set the timeframe constraints
@@ -135,53 +420,176 @@ public Q_SLOTS:
 
     void freebusyDataChanged();
 
+    /**
+     * Searches the free slots synchronously, on the calling thread.
+     * Changes of the constraints or of the free/busy data schedule a search
+     * on a worker thread instead, whose result is dropped if it got outdated
+     * by further changes in the meantime.
+     */
     void findAllFreeSlots();
 
     void setResolution(int seconds);
 
 private:
     /**
-      Checks whether the slot specified by (tryFrom, tryTo) matches the
-      search constraints. If yes, return true. The return value is the
-      number of conflicts that were detected, and (tryFrom, tryTo) contain the next free slot for
-      that participant. In other words, the returned slot does not have to
-      be free for everybody else.
-    */
-    INCIDENCEEDITOR_NO_EXPORT int tryDate(QDateTime &tryFrom, QDateTime &tryTo);
+     * Checks whether the supplied attendee passes the
+     * current mandatory role constraint.
+     * @return true if the attendee is of one of the mandatory roles, false if not
+     */
+    INCIDENCEEDITOR_NO_EXPORT bool matchesRoleConstraint(const KCalendarCore::Attendee &attendee) const;
 
     /**
-      Checks whether the slot specified by (tryFrom, tryTo) is available
-      for the participant with specified fb. If yes, return true. If
-      not, return false and change (tryFrom, tryTo) to contain the next
-      possible slot for this participant (not necessarily a slot that is
-      available for all participants).
-    */
-    INCIDENCEEDITOR_NO_EXPORT bool tryDate(const KCalendarCore::FreeBusy::Ptr &fb, QDateTime &tryFrom, QDateTime &tryTo);
+     * Returns the row of model() showing @p attendee, or -1 if there is none.
+     */
+    [[nodiscard]] INCIDENCEEDITOR_NO_EXPORT int busyRowOf(const KCalendarCore::Attendee &attendee) const;
 
     /**
-     * Checks whether the supplied attendee passes the
-     * current mandatory role constraint.
-     * @return true if the attendee is of one of the mandatory roles, false if not
+     * The slot grid of a free slot search: range slots of resolution seconds, starting at begin.
+     * All computations use the seconds since epoch, begin is only used to convert the
+     * results back into date times, in the time zone of the timeframe.
+     */
+    struct SlotGrid {
+        QDateTime begin;
+        qint64 beginSecs = 0;
+        qint64 endSecs = 0;
+        qint64 range = 0;
+        int resolution = 0;
+
+        [[nodiscard]] bool operator==(const SlotGrid &other) const
+        {
+            return beginSecs == other.beginSecs && endSecs == other.endSecs && range == other.range && resolution == other.resolution;
+        }
+    };
+
+    /**
+     * A busy period with its status, in seconds since epoch.
      */
-    INCIDENCEEDITOR_NO_EXPORT bool matchesRoleConstraint(const KCalendarCore::Attendee &attendee);
+    struct StatusInterval {
+        qint64 start;
+        qint64 end;
+        KCalendarCore::FreeBusyPeriod::FreeBusyType type;
+    };
 
+    /**
+     * Cached busy information of one row of the FreeBusyItemModel.
+     */
+    struct BusyRow {
+        KCalendarCore::Attendee attendee;
+        bool hasFreeBusy = false;
+        BusyIntervals busyIntervals;
+        QList<StatusInterval> statusIntervals; //!< the busy periods sorted by start, not merged
+        QList<SlotRun> slotRuns; //!< busy slots on the current grid, run-length encoded
+        bool conflicts = false; //!< whether the attendee is busy during the timeframe constraint
+    };
+
+    INCIDENCEEDITOR_NO_EXPORT void slotFreeBusyRowsInserted(const QModelIndex &parent, int first, int last);
+    INCIDENCEEDITOR_NO_EXPORT void slotFreeBusyRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    INCIDENCEEDITOR_NO_EXPORT void slotFreeBusyRowsChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+
+    INCIDENCEEDITOR_NO_EXPORT BusyRow createBusyRow(int modelRow) const;
+    INCIDENCEEDITOR_NO_EXPORT bool rowConflicts(const BusyRow &row) const;
+    INCIDENCEEDITOR_NO_EXPORT bool rowCountsOnGrid(const BusyRow &row) const;
+    INCIDENCEEDITOR_NO_EXPORT void addToSlotConflicts(const BusyRow &row, int delta);
+    INCIDENCEEDITOR_NO_EXPORT void rebuildSlotConflicts();
+
+    /**
+     * Sets mTimeframeConstraint and its seconds since epoch, then calls constraintsChanged().
+     */
+    INCIDENCEEDITOR_NO_EXPORT void setTimeframe(const KCalendarCore::Period &timeframe);
+
+    /**
+     * Recomputes the conflicts of all rows, for when the timeframe or the role constraint changed.
+     */
     INCIDENCEEDITOR_NO_EXPORT void calculateConflicts();
 
+    /**
+     * Recomputes the conflicts, unless a constraints update is in progress.
+     * @see beginConstraintsUpdate
+     */
+    INCIDENCEEDITOR_NO_EXPORT void constraintsChanged();
+
+    /**
+     * Announces the current number of conflicts and schedules a free slot search.
+     */
+    INCIDENCEEDITOR_NO_EXPORT void publishConflicts();
+
+    struct SearchInput;
+    struct SearchResult;
+    class SlotBatchReporter;
+
+    /**
+     * Takes a snapshot of the constraints and the cached busy rows.
+     */
+    INCIDENCEEDITOR_NO_EXPORT SearchInput createSearchInput() const;
+    INCIDENCEEDITOR_NO_EXPORT void startFreeSlotSearch();
+    INCIDENCEEDITOR_NO_EXPORT void cancelFreeSlotSearch();
+    INCIDENCEEDITOR_NO_EXPORT void installSearchResult(const SearchResult &result);
+    INCIDENCEEDITOR_NO_EXPORT void reportFreeSlots(const SearchResult &batch);
+
+    // The search itself only works on the snapshot, so it can run on a worker thread
+    INCIDENCEEDITOR_NO_EXPORT static SearchResult runFreeSlotSearch(const SearchInput &input,
+                                                                    const std::function<void(const KCalendarCore::Period::List &)> &reportSlots = {});
+    INCIDENCEEDITOR_NO_EXPORT static void searchGridProgressively(const SearchInput &input, SearchResult &result, SlotBatchReporter &reporter);
+    INCIDENCEEDITOR_NO_EXPORT static QList<SlotRun> slotRunsForIntervals(const BusyIntervals &intervals, const SlotGrid &grid);
+    /**
+     * Converts the intervals from @p cursor on which start before @p untilSecs (relative to the
+     * begin of the grid) and appends their runs, merged with the last run if they touch.
+     */
+    INCIDENCEEDITOR_NO_EXPORT static void
+    appendSlotRuns(QList<SlotRun> &slotRuns, const BusyIntervals &intervals, const SlotGrid &grid, qsizetype &cursor, qint64 untilSecs);
+    /**
+     * Returns the time of the timeframe blocked by the weekday and the working hours constraints.
+     */
+    INCIDENCEEDITOR_NO_EXPORT static BusyIntervals constraintIntervals(const SearchInput &input);
+    /**
+     * Returns the sorted, merged slot runs in which a mandatory attendee is busy or
+     * which are blocked by the weekday and the working hours constraints.
+     */
+    INCIDENCEEDITOR_NO_EXPORT static QList<SlotRun> blockedRunsOnGrid(const SearchInput &input);
+    INCIDENCEEDITOR_NO_EXPORT static KCalendarCore::Period::List
+    freeSlotsOnGrid(const QMap<qint64, int> &conflictDeltas, const SlotGrid &grid, const BusyIntervals &blocked);
+    INCIDENCEEDITOR_NO_EXPORT static KCalendarCore::Period::List
+    freeSlotsBySweep(QList<BusyIntervals> busyLists, const SlotGrid &grid, const std::function<bool()> &isCanceled = {});
+
     KCalendarCore::Period mTimeframeConstraint; //!< the datetime range for outside of which
     // free slots won't be searched.
+    qint64 mTimeframeStart = 0; //!< mTimeframeConstraint in seconds since epoch
+    qint64 mTimeframeEnd = 0;
     KCalendarCore::Period::List mAvailableSlots;
 
     QTimer mCalculateTimer; //!< A timer is used control the calculation of conflicts
     // to prevent the process from being repeated many times
     // after a series of quick parameter changes.
 
-    CalendarSupport::FreeBusyItemModel *const mFBModel;
+    FreeBusyAttendeeModel *const mFBModel;
+    CalendarSupport::FreeBusyItemModel *const mRoomModel;
     QWidget *mParentWidget = nullptr;
 
     QSet<KCalendarCore::Attendee::Role> mMandatoryRoles;
+    QHash<KCalendarCore::Attendee::Role, int> mRoleWeights;
+    QHash<KCalendarCore::FreeBusyPeriod::FreeBusyType, int> mStatusWeights; //!< in percent
     QBitArray mWeekdays; //!< a 7 bit array indicating the allowed days
     //(bit 0 = Monday, value 1 = allowed).
+    QTime mWorkingHoursStart; //!< invalid if there is no working hours constraint
+    QTime mWorkingHoursEnd;
+    QTimeZone mWorkingHoursTimeZone;
 
     int mSlotResolutionSeconds;
+    int mSearchHorizonDays;
+    FreeSlotEngine mFreeSlotEngine = SlotGridEngine;
+
+    QList<BusyRow> mBusyRows; //!< one entry per row of mFBModel
+    int mConflictCount = 0; //!< number of rows conflicting with the timeframe constraint
+
+    SlotGrid mGrid; //!< the slot grid the cached BusyRow::slotRuns refer to
+    bool mGridValid = false;
+    int mConstraintsUpdateDepth = 0;
+    bool mConstraintsChanged = false; //!< a constraint changed since beginConstraintsUpdate()
+    quint64 mSearchGeneration = 0; //!< bumped on every change, outdates running searches
+    QPointer<QFutureWatcherBase> mSearchWatcher; //!< of the latest search on a worker thread, canceled when outdated
+    quint64 mReportedGeneration = 0; //!< the search whose progressive results were reported last
+    int mProgressiveBatchSize = 0;
+    ConflictHistogram mConflictHistogram;
+    QMap<qint64, int> mConflictDeltas; //!< change of the number of busy attendees at each slot run boundary
 };
 }
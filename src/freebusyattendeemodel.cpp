@@ -0,0 +1,67 @@
+/*
+  SPDX-FileCopyrightText: 2026 KDE PIM developers <kde-pim@kde.org>
+
+  SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "freebusyattendeemodel.h"
+
+using namespace IncidenceEditorNG;
+
+FreeBusyAttendeeModel::FreeBusyAttendeeModel(QObject *parent)
+    : CalendarSupport::FreeBusyItemModel(parent)
+{
+    connect(this, &FreeBusyAttendeeModel::rowsAboutToBeRemoved, this, &FreeBusyAttendeeModel::slotRowsAboutToBeRemoved);
+    connect(this, &FreeBusyAttendeeModel::modelAboutToBeReset, this, [this]() {
+        mAttendees.clear();
+    });
+}
+
+FreeBusyAttendeeModel::~FreeBusyAttendeeModel() = default;
+
+void FreeBusyAttendeeModel::setAttendee(int row, const KCalendarCore::Attendee &attendee)
+{
+    const QModelIndex index = this->index(row, 0);
+    if (!index.isValid()) {
+        return;
+    }
+    const KCalendarCore::Attendee current = itemAttendee(row);
+    if (current.email().toLower() != attendee.email().toLower()) {
+        return;
+    }
+    // the item keeps its attendee, it is still the one removeAttendee() has to be given
+    if (attendee == current) {
+        mAttendees.remove(current.email().toLower());
+    } else {
+        mAttendees.insert(current.email().toLower(), attendee);
+    }
+    Q_EMIT dataChanged(index, index);
+}
+
+KCalendarCore::Attendee FreeBusyAttendeeModel::itemAttendee(int row) const
+{
+    return CalendarSupport::FreeBusyItemModel::data(index(row, 0), AttendeeRole).value<KCalendarCore::Attendee>();
+}
+
+QVariant FreeBusyAttendeeModel::data(const QModelIndex &index, int role) const
+{
+    if (index.isValid() && !index.parent().isValid() && (role == Qt::DisplayRole || role == AttendeeRole) && !mAttendees.isEmpty()) {
+        const auto it = mAttendees.constFind(itemAttendee(index.row()).email().toLower());
+        if (it != mAttendees.cend()) {
+            return role == Qt::DisplayRole ? QVariant(it->fullName()) : QVariant::fromValue(*it);
+        }
+    }
+    return CalendarSupport::FreeBusyItemModel::data(index, role);
+}
+
+void FreeBusyAttendeeModel::slotRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid() || mAttendees.isEmpty()) {
+        return;
+    }
+    for (int i = first; i <= last; ++i) {
+        mAttendees.remove(itemAttendee(i).email().toLower());
+    }
+}
+
+#include "moc_freebusyattendeemodel.cpp"
@@ -0,0 +1,50 @@
+/*
+  SPDX-FileCopyrightText: 2026 KDE PIM developers <kde-pim@kde.org>
+
+  SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "incidenceeditor_export.h"
+
+#include <CalendarSupport/FreeBusyItemModel>
+
+#include <KCalendarCore/Attendee>
+
+#include <QHash>
+
+namespace IncidenceEditorNG
+{
+/**
+ * The attendee model of the ConflictResolver. Unlike its base class it can show a
+ * changed attendee, e.g. a new name or role, in the row of the old one, so the row
+ * keeps its position and its free/busy info.
+ */
+class FreeBusyAttendeeModel : public CalendarSupport::FreeBusyItemModel
+{
+    Q_OBJECT
+public:
+    explicit FreeBusyAttendeeModel(QObject *parent = nullptr);
+    ~FreeBusyAttendeeModel() override;
+
+    /**
+     * Shows @p attendee in the top level row @p row and emits dataChanged() for it.
+     * The email of @p attendee has to be the one of the row.
+     */
+    void setAttendee(int row, const KCalendarCore::Attendee &attendee);
+
+    /**
+     * Returns the attendee of the FreeBusyItem in row @p row, i.e. the one the base
+     * class compares in containsAttendee() and removeAttendee().
+     */
+    [[nodiscard]] KCalendarCore::Attendee itemAttendee(int row) const;
+
+    [[nodiscard]] QVariant data(const QModelIndex &index, int role) const override;
+
+private:
+    INCIDENCEEDITOR_NO_EXPORT void slotRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+
+    QHash<QString, KCalendarCore::Attendee> mAttendees; //!< the changed attendees, by lower case email
+};
+}
@@ -0,0 +1,618 @@
+/*
+  SPDX-FileCopyrightText: 2026 KDE PIM developers <kde-pim@kde.org>
+
+  SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "freebusycache.h"
+#include "busyintervals.h"
+#include "incidenceeditor_debug.h"
+#include "incidenceeditorsettings.h"
+
+#include <Akonadi/FreeBusyManager>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimeZone>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+using namespace IncidenceEditorNG;
+
+static const int DEFAULT_TIME_TO_LIVE_SECONDS = 5 * 60;
+static const int FETCH_TIMEOUT_MSECS = 60 * 1000; // a fetch may fail without any answer
+static const int DEFAULT_MAXIMUM_FETCHES = 4;
+static const int MAXIMUM_FETCHES_PER_HOST = 2; // don't hammer a single server
+static const int SAVE_DELAY_MSECS = 2000; // several fetches usually arrive at once
+static const qint64 MAXIMUM_SNAPSHOT_AGE_MSECS = 7LL * 24 * 60 * 60 * 1000; // older free/busy info is of no use
+static const qsizetype MAXIMUM_SNAPSHOT_BLOCKS = 1000; // the most recently fetched attendees are kept
+
+// The snapshot file is a header followed by one block per attendee, all 8 byte aligned
+// and in the byte order of the host: a file written elsewhere doesn't match the magic.
+static const quint32 SNAPSHOT_MAGIC = 0x46425331; // "FBS1"
+static const quint32 SNAPSHOT_VERSION = 1;
+
+namespace
+{
+struct SnapshotHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 blockCount;
+    quint32 reserved;
+};
+
+struct SnapshotBlockHeader {
+    qint64 fetched; //!< msecs since epoch
+    quint32 emailSize; //!< of the UTF-8 email following the header, padded to 8 bytes
+    quint32 intervalCount; //!< of the pairs of qint64 following the email
+};
+
+qint64 padded(qint64 size)
+{
+    return (size + 7) & ~qint64(7);
+}
+
+QString hostOf(const QString &key)
+{
+    return key.section(QLatin1Char('@'), -1);
+}
+
+bool snapshotEnabled()
+{
+    return IncidenceEditorSettings::self()->freeBusySnapshot();
+}
+
+bool retrieveFreeBusy(const QString &email, QWidget *parentWidget)
+{
+    return Akonadi::FreeBusyManager::self()->retrieveFreeBusy(email, false, parentWidget);
+}
+
+template<typename T>
+void appendRaw(QByteArray &data, const T &value)
+{
+    data.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+}
+
+FreeBusyCache *FreeBusyCache::mSelf = nullptr;
+
+FreeBusyCache *FreeBusyCache::self()
+{
+    if (!mSelf) {
+        mSelf = new FreeBusyCache();
+    }
+
+    return mSelf;
+}
+
+FreeBusyCache::FreeBusyCache()
+    : QObject(QCoreApplication::instance()) // deleted with the application, saving a pending snapshot
+    , mMaximumFetches(DEFAULT_MAXIMUM_FETCHES)
+    , mFetcher(retrieveFreeBusy)
+    , mTimeToLive(DEFAULT_TIME_TO_LIVE_SECONDS)
+    , mExpiredBefore(QDateTime::currentMSecsSinceEpoch())
+{
+    connect(Akonadi::FreeBusyManager::self(), &Akonadi::FreeBusyManager::freeBusyRetrieved, this, &FreeBusyCache::slotFreeBusyRetrieved);
+
+    mFetchTimeoutTimer.setSingleShot(true);
+    mFetchTimeoutTimer.setInterval(FETCH_TIMEOUT_MSECS);
+    connect(&mFetchTimeoutTimer, &QTimer::timeout, this, &FreeBusyCache::startFetches);
+
+    mSaveTimer.setSingleShot(true);
+    mSaveTimer.setInterval(SAVE_DELAY_MSECS);
+    connect(&mSaveTimer, &QTimer::timeout, this, &FreeBusyCache::saveSnapshot);
+
+    mExpiryTimer.setSingleShot(true);
+    connect(&mExpiryTimer, &QTimer::timeout, this, &FreeBusyCache::refreshExpiredItems);
+
+    if (QCoreApplication::instance()) {
+        // the save timer doesn't fire anymore once the event loop is done
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &FreeBusyCache::savePendingSnapshot);
+    }
+
+    const QString snapshot = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/incidenceeditor/freebusy.snapshot");
+    if (!snapshotEnabled()) {
+        // the calendar data of others isn't kept on disk, e.g. from when the snapshot was enabled
+        QFile::remove(snapshot);
+    }
+    setSnapshotFile(snapshot);
+}
+
+FreeBusyCache::~FreeBusyCache()
+{
+    savePendingSnapshot();
+    unmapSnapshot();
+    mSelf = nullptr;
+}
+
+CalendarSupport::FreeBusyItem::Ptr FreeBusyCache::createItem(const KCalendarCore::Attendee &attendee, QWidget *parentWidget, FetchPriority priority)
+{
+    CalendarSupport::FreeBusyItem::Ptr item(new CalendarSupport::FreeBusyItem(attendee, parentWidget));
+    if (const KCalendarCore::FreeBusy::Ptr freeBusy = lookup(attendee.email())) {
+        item->setFreeBusy(freeBusy);
+    } else {
+        request(attendee.email(), parentWidget, priority);
+        // outdated, but better than nothing until the fetch is done
+        if (const KCalendarCore::FreeBusy::Ptr freeBusy = lastKnown(attendee.email())) {
+            item->setFreeBusy(freeBusy);
+        }
+    }
+    if (!attendee.email().isEmpty()) {
+        const QString key = attendee.email().toLower();
+        mItems.insert(key, {item, parentWidget});
+        updateItems(key);
+        scheduleExpiry();
+    }
+    return item;
+}
+
+KCalendarCore::FreeBusy::Ptr FreeBusyCache::lookup(const QString &email) const
+{
+    const auto it = mEntries.constFind(email.toLower());
+    if (it == mEntries.cend() || QDateTime::currentMSecsSinceEpoch() - it->fetched >= qint64(mTimeToLive) * 1000) {
+        return {};
+    }
+    return it->freeBusy;
+}
+
+KCalendarCore::FreeBusy::Ptr FreeBusyCache::lastKnown(const QString &email) const
+{
+    const QString key = email.toLower();
+    const auto it = mEntries.constFind(key);
+    if (it != mEntries.cend()) {
+        return it->freeBusy;
+    }
+    const auto block = mSnapshotBlocks.constFind(key);
+    if (block != mSnapshotBlocks.cend()) {
+        return freeBusyFromBlock(*block);
+    }
+    return {};
+}
+
+void FreeBusyCache::insert(const QString &email, const KCalendarCore::FreeBusy::Ptr &freeBusy, const QDateTime &fetched)
+{
+    cacheFreeBusy(email, freeBusy, fetched, QString());
+}
+
+void FreeBusyCache::cacheFreeBusy(const QString &email, const KCalendarCore::FreeBusy::Ptr &freeBusy, const QDateTime &fetched, const QString &deliveredEmail)
+{
+    if (!freeBusy) {
+        return;
+    }
+    const QString key = email.toLower();
+    Entry &entry = mEntries[key];
+    entry.freeBusy = freeBusy;
+    entry.fetched = fetched.isValid() ? fetched.toMSecsSinceEpoch() : QDateTime::currentMSecsSinceEpoch();
+    if (snapshotEnabled()) {
+        mSaveTimer.start();
+    }
+
+    mQueuedFetches.removeIf([&key](const QueuedFetch &fetch) {
+        return fetch.key == key;
+    });
+    if (mFetches.remove(key)) {
+        startFetches();
+    }
+
+    // The models match the fetch result by the exact email, while the cache doesn't care about the
+    // letter case. So the items get the info from here, and their models are told through
+    // freeBusyCached(), unless they already got it from the Akonadi::FreeBusyManager.
+    QSet<QString> emails;
+    for (auto it = mItems.find(key); it != mItems.end() && it.key() == key;) {
+        if (const CalendarSupport::FreeBusyItem::Ptr item = it->item.toStrongRef()) {
+            item->setFreeBusy(freeBusy);
+            item->setIsDownloading(false);
+            if (item->email() != deliveredEmail) {
+                emails.insert(item->email());
+            }
+            ++it;
+        } else {
+            it = mItems.erase(it);
+        }
+    }
+    for (const QString &itemEmail : std::as_const(emails)) {
+        Q_EMIT freeBusyCached(itemEmail, freeBusy);
+    }
+    scheduleExpiry();
+}
+
+void FreeBusyCache::request(const QString &email, QWidget *parentWidget, FetchPriority priority)
+{
+    if (email.isEmpty() || lookup(email)) {
+        return;
+    }
+    const QString key = email.toLower();
+    const auto running = mFetches.constFind(key);
+    if (running != mFetches.cend() && !running->hasExpired()) {
+        return;
+    }
+    const auto queued = std::find_if(mQueuedFetches.cbegin(), mQueuedFetches.cend(), [&key](const QueuedFetch &fetch) {
+        return fetch.key == key;
+    });
+    if (queued != mQueuedFetches.cend()) {
+        if (queued->priority <= priority) {
+            return;
+        }
+        mQueuedFetches.erase(queued);
+    }
+    // behind the fetches of the same or a higher priority
+    const auto position = std::find_if(mQueuedFetches.cbegin(), mQueuedFetches.cend(), [priority](const QueuedFetch &fetch) {
+        return fetch.priority > priority;
+    });
+    mQueuedFetches.insert(position, {key, email, parentWidget, priority});
+    startFetches();
+    updateItems(key);
+}
+
+void FreeBusyCache::startFetches()
+{
+    // a fetch may fail without any answer, it doesn't block the queue forever
+    QHash<QString, int> hostFetches;
+    QStringList expired;
+    for (auto it = mFetches.begin(); it != mFetches.end();) {
+        if (it->hasExpired()) {
+            expired << it.key();
+            it = mFetches.erase(it);
+        } else {
+            ++hostFetches[hostOf(it.key())];
+            ++it;
+        }
+    }
+
+    for (qsizetype i = 0; i < mQueuedFetches.size() && mFetches.size() < mMaximumFetches;) {
+        const QString host = hostOf(mQueuedFetches.at(i).key);
+        if (hostFetches.value(host) >= MAXIMUM_FETCHES_PER_HOST) {
+            ++i;
+            continue;
+        }
+        const QueuedFetch fetch = mQueuedFetches.takeAt(i);
+        mFetches.insert(fetch.key, QDeadlineTimer(FETCH_TIMEOUT_MSECS));
+        if (mFetcher(fetch.email, fetch.parentWidget)) {
+            ++hostFetches[host];
+        } else {
+            qCDebug(INCIDENCEEDITOR_LOG) << "Unable to fetch the free/busy info of" << fetch.email;
+            mFetches.remove(fetch.key);
+            updateItems(fetch.key);
+        }
+    }
+
+    if (!mFetches.isEmpty()) {
+        mFetchTimeoutTimer.start();
+    }
+    for (const QString &key : std::as_const(expired)) {
+        qCDebug(INCIDENCEEDITOR_LOG) << "Fetching the free/busy info of" << key << "timed out";
+        updateItems(key);
+    }
+}
+
+void FreeBusyCache::fetchFailed(const QString &key)
+{
+    if (mFetches.remove(key)) {
+        startFetches();
+        updateItems(key);
+    }
+}
+
+void FreeBusyCache::updateItems(const QString &key)
+{
+    // The items are downloading while the cache fetches them or serves them fresh info.
+    // Otherwise their model may fetch them, e.g. after a failed fetch when it is reloaded.
+    const bool downloading = lookup(key) || isFetching(key);
+    for (auto it = mItems.find(key); it != mItems.end() && it.key() == key;) {
+        if (const CalendarSupport::FreeBusyItem::Ptr item = it->item.toStrongRef()) {
+            item->setIsDownloading(downloading);
+            ++it;
+        } else {
+            it = mItems.erase(it);
+        }
+    }
+}
+
+void FreeBusyCache::scheduleExpiry()
+{
+    // the next time the fresh free/busy info of an item expires
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 next = std::numeric_limits<qint64>::max();
+    for (auto it = mItems.keyBegin(), end = mItems.keyEnd(); it != end; ++it) {
+        const auto entry = mEntries.constFind(*it);
+        if (entry != mEntries.cend() && entry->fetched + qint64(mTimeToLive) * 1000 > now) {
+            next = std::min(next, entry->fetched + qint64(mTimeToLive) * 1000);
+        }
+    }
+    if (next == std::numeric_limits<qint64>::max()) {
+        mExpiryTimer.stop();
+    } else {
+        mExpiryTimer.start(std::chrono::milliseconds(next - now));
+    }
+}
+
+void FreeBusyCache::refreshExpiredItems()
+{
+    // Fetches the info which expired since the last time again, once. If that fails,
+    // the models of the items take over. The fetches are requested after the loop,
+    // as requesting updates the items.
+    struct Refresh {
+        QString email;
+        QPointer<QWidget> parentWidget;
+    };
+    QHash<QString, Refresh> refreshes;
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = mItems.cbegin(), end = mItems.cend(); it != end; ++it) {
+        const auto entry = mEntries.constFind(it.key());
+        if (entry == mEntries.cend() || refreshes.contains(it.key())) {
+            continue;
+        }
+        const qint64 expiry = entry->fetched + qint64(mTimeToLive) * 1000;
+        if (expiry <= mExpiredBefore || expiry > now) {
+            continue;
+        }
+        if (const CalendarSupport::FreeBusyItem::Ptr item = it->item.toStrongRef()) {
+            refreshes.insert(it.key(), {item->attendee().email(), it->parentWidget});
+        }
+    }
+    mExpiredBefore = now;
+    for (const Refresh &refresh : std::as_const(refreshes)) {
+        request(refresh.email, refresh.parentWidget, LowFetchPriority);
+    }
+    scheduleExpiry();
+}
+
+void FreeBusyCache::savePendingSnapshot()
+{
+    if (mSaveTimer.isActive()) {
+        saveSnapshot();
+    }
+}
+
+bool FreeBusyCache::isFetching(const QString &email) const
+{
+    const QString key = email.toLower();
+    const auto it = mFetches.constFind(key);
+    if (it != mFetches.cend() && !it->hasExpired()) {
+        return true;
+    }
+    return std::any_of(mQueuedFetches.cbegin(), mQueuedFetches.cend(), [&key](const QueuedFetch &fetch) {
+        return fetch.key == key;
+    });
+}
+
+void FreeBusyCache::setMaximumFetches(int count)
+{
+    mMaximumFetches = std::max(count, 1);
+    startFetches();
+}
+
+int FreeBusyCache::maximumFetches() const
+{
+    return mMaximumFetches;
+}
+
+void FreeBusyCache::setFetcher(const std::function<bool(const QString &email, QWidget *parentWidget)> &fetcher)
+{
+    mFetcher = fetcher ? fetcher : retrieveFreeBusy;
+}
+
+void FreeBusyCache::invalidate(const QString &email)
+{
+    const QString key = email.toLower();
+    const bool cached = mEntries.remove(key);
+    const bool saved = mSnapshotBlocks.remove(key);
+    if (saved) {
+        // the file may be read again before saving, the block must not come back
+        mDroppedBlocks.insert(key);
+    }
+    if ((cached || saved) && snapshotEnabled()) {
+        mSaveTimer.start();
+    }
+    updateItems(key);
+}
+
+void FreeBusyCache::clear()
+{
+    mEntries.clear();
+    const QList<QString> keys = mItems.uniqueKeys();
+    for (const QString &key : keys) {
+        updateItems(key);
+    }
+    scheduleExpiry();
+}
+
+void FreeBusyCache::setTimeToLive(int seconds)
+{
+    mTimeToLive = seconds;
+    scheduleExpiry();
+}
+
+int FreeBusyCache::timeToLive() const
+{
+    return mTimeToLive;
+}
+
+void FreeBusyCache::slotFreeBusyRetrieved(const KCalendarCore::FreeBusy::Ptr &freeBusy, const QString &email)
+{
+    if (freeBusy) {
+        // also the fetches of others are cached
+        cacheFreeBusy(email, freeBusy, {}, email);
+    } else {
+        fetchFailed(email.toLower());
+    }
+}
+
+void FreeBusyCache::setSnapshotFile(const QString &fileName)
+{
+    unmapSnapshot();
+    mSnapshotFile.setFileName(fileName);
+    mapSnapshot();
+}
+
+QString FreeBusyCache::snapshotFile() const
+{
+    return mSnapshotFile.fileName();
+}
+
+void FreeBusyCache::mapSnapshot()
+{
+    if (!snapshotEnabled() || !mSnapshotFile.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const qint64 size = mSnapshotFile.size();
+    if (size >= qint64(sizeof(SnapshotHeader))) {
+        mSnapshotData = mSnapshotFile.map(0, size);
+    }
+    if (!mSnapshotData) {
+        mSnapshotFile.close();
+        return;
+    }
+
+    SnapshotHeader header;
+    std::memcpy(&header, mSnapshotData, sizeof(header));
+    if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION) {
+        qCDebug(INCIDENCEEDITOR_LOG) << "Ignoring the free/busy snapshot" << mSnapshotFile.fileName();
+        unmapSnapshot();
+        return;
+    }
+
+    // only the blocks are indexed, the intervals are read when they are needed
+    qint64 offset = sizeof(SnapshotHeader);
+    for (quint32 i = 0; i < header.blockCount; ++i) {
+        if (offset + qint64(sizeof(SnapshotBlockHeader)) > size) {
+            break;
+        }
+        SnapshotBlockHeader blockHeader;
+        std::memcpy(&blockHeader, mSnapshotData + offset, sizeof(blockHeader));
+        const qint64 emailOffset = offset + sizeof(SnapshotBlockHeader);
+        const qint64 intervalsOffset = emailOffset + padded(blockHeader.emailSize);
+        const qint64 end = intervalsOffset + qint64(blockHeader.intervalCount) * 2 * sizeof(qint64);
+        if (end > size) {
+            qCDebug(INCIDENCEEDITOR_LOG) << "Truncated free/busy snapshot" << mSnapshotFile.fileName();
+            break;
+        }
+        SnapshotBlock block;
+        block.fetched = blockHeader.fetched;
+        block.intervals = reinterpret_cast<const qint64 *>(mSnapshotData + intervalsOffset);
+        block.count = blockHeader.intervalCount;
+        mSnapshotBlocks.insert(QString::fromUtf8(reinterpret_cast<const char *>(mSnapshotData + emailOffset), blockHeader.emailSize), block);
+        offset = end;
+    }
+}
+
+void FreeBusyCache::unmapSnapshot()
+{
+    mSnapshotBlocks.clear();
+    if (mSnapshotData) {
+        mSnapshotFile.unmap(mSnapshotData);
+        mSnapshotData = nullptr;
+    }
+    mSnapshotFile.close();
+}
+
+bool FreeBusyCache::saveSnapshot()
+{
+    mSaveTimer.stop();
+
+    const QString fileName = mSnapshotFile.fileName();
+    // another process may have saved its fetches since the file was mapped, they are kept
+    unmapSnapshot();
+    if (!snapshotEnabled()) {
+        if (!fileName.isEmpty()) {
+            QFile::remove(fileName);
+        }
+        return false;
+    }
+    mapSnapshot();
+
+    // the most recent info of each attendee, from this process or from the file
+    struct Candidate {
+        QString key;
+        qint64 fetched;
+        const Entry *entry;
+        const SnapshotBlock *block;
+    };
+    QList<Candidate> candidates;
+    candidates.reserve(mEntries.size() + mSnapshotBlocks.size());
+    for (auto it = mEntries.cbegin(), end = mEntries.cend(); it != end; ++it) {
+        const auto block = mSnapshotBlocks.constFind(it.key());
+        if (block == mSnapshotBlocks.cend() || block->fetched <= it->fetched) {
+            candidates.append({it.key(), it->fetched, &it.value(), nullptr});
+        }
+    }
+    for (auto it = mSnapshotBlocks.cbegin(), end = mSnapshotBlocks.cend(); it != end; ++it) {
+        const auto entry = mEntries.constFind(it.key());
+        if ((entry == mEntries.cend() || entry->fetched < it->fetched) && !mDroppedBlocks.contains(it.key())) {
+            candidates.append({it.key(), it->fetched, nullptr, &it.value()});
+        }
+    }
+    // outdated info is dropped and the file doesn't grow with every attendee ever looked up
+    const qint64 oldest = QDateTime::currentMSecsSinceEpoch() - MAXIMUM_SNAPSHOT_AGE_MSECS;
+    candidates.removeIf([oldest](const Candidate &candidate) {
+        return candidate.fetched < oldest;
+    });
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &left, const Candidate &right) {
+        return left.fetched > right.fetched;
+    });
+    if (candidates.size() > MAXIMUM_SNAPSHOT_BLOCKS) {
+        candidates.resize(MAXIMUM_SNAPSHOT_BLOCKS);
+    }
+
+    QByteArray data;
+    quint32 blockCount = 0;
+    const auto appendBlock = [&data, &blockCount](const QString &email, qint64 fetched, const qint64 *intervals, quint32 count) {
+        const QByteArray utf8 = email.toUtf8();
+        appendRaw(data, SnapshotBlockHeader{fetched, quint32(utf8.size()), count});
+        data.append(utf8);
+        data.append(padded(utf8.size()) - utf8.size(), '\0');
+        data.append(reinterpret_cast<const char *>(intervals), qsizetype(count) * 2 * sizeof(qint64));
+        ++blockCount;
+    };
+
+    data.resize(sizeof(SnapshotHeader));
+    QList<qint64> intervals;
+    for (const Candidate &candidate : std::as_const(candidates)) {
+        if (candidate.block) {
+            appendBlock(candidate.key, candidate.fetched, candidate.block->intervals, candidate.block->count);
+            continue;
+        }
+        const BusyIntervals busy(candidate.entry->freeBusy->busyPeriods());
+        intervals.clear();
+        intervals.reserve(busy.size() * 2);
+        for (qsizetype i = 0; i < busy.size(); ++i) {
+            intervals << busy.at(i).start << busy.at(i).end;
+        }
+        appendBlock(candidate.key, candidate.fetched, intervals.constData(), quint32(busy.size()));
+    }
+    const SnapshotHeader header{SNAPSHOT_MAGIC, SNAPSHOT_VERSION, blockCount, 0};
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    // the busy times of others are only readable by the user
+    const bool saved = file.open(QIODevice::WriteOnly) && file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner)
+        && file.write(data) == data.size() && file.commit();
+    if (saved) {
+        mDroppedBlocks.clear();
+    } else {
+        qCWarning(INCIDENCEEDITOR_LOG) << "Unable to save the free/busy snapshot" << fileName << file.errorString();
+    }
+    unmapSnapshot();
+    mapSnapshot();
+    return saved;
+}
+
+KCalendarCore::FreeBusy::Ptr FreeBusyCache::freeBusyFromBlock(const SnapshotBlock &block)
+{
+    KCalendarCore::Period::List periods;
+    periods.reserve(block.count);
+    for (quint32 i = 0; i < block.count; ++i) {
+        qint64 interval[2];
+        std::memcpy(interval, block.intervals + 2 * i, sizeof(interval));
+        periods << KCalendarCore::Period(QDateTime::fromSecsSinceEpoch(interval[0], QTimeZone::utc()), QDateTime::fromSecsSinceEpoch(interval[1], QTimeZone::utc()));
+    }
+    return KCalendarCore::FreeBusy::Ptr(new KCalendarCore::FreeBusy(periods));
+}
+
+#include "moc_freebusycache.cpp"
@@ -0,0 +1,224 @@
+/*
+  SPDX-FileCopyrightText: 2026 KDE PIM developers <kde-pim@kde.org>
+
+  SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "incidenceeditor_private_export.h"
+
+#include <CalendarSupport/FreeBusyItem>
+
+#include <KCalendarCore/FreeBusy>
+
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QFile>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
+
+#include <functional>
+
+class QWidget;
+
+namespace IncidenceEditorNG
+{
+/**
+ * The free/busy info of attendees, shared by all editors of the process.
+ *
+ * Every ConflictResolver and the resource management dialog have a free/busy model
+ * of their own. They take the free/busy info from here, so opening several invites
+ * for the same people fetches it only once. The entries are keyed by email and
+ * expire after timeToLive(). A fetch which is still running is not started again.
+ *
+ * The fetched info is set on the items handed out for the email, whatever its letter
+ * case. Their models get it through freeBusyCached(), or from the Akonadi::FreeBusyManager
+ * they listen to as well.
+ *
+ * Only a few fetches run at a time, and only two per host (the domain of the email).
+ * The others wait in a queue, the ones of high priority first, so for a large invite
+ * the mandatory attendees are known early and the conflicts are counted as their
+ * free/busy info arrives.
+ *
+ * If enabled in the settings, the cache is kept in a snapshot file, so a new process
+ * shows the last known free/busy info right away while fetching it again. Only the
+ * owner can read the file. It keeps the info of the last week and of a limited number
+ * of attendees, merged with the info saved by other processes. The file is memory
+ * mapped, an attendee is only read from it when needed. It holds one block per
+ * attendee: the email, the fetch time and the sorted, merged busy intervals as pairs
+ * of seconds since epoch. The free/busy status of the periods is not kept.
+ * A pending save is done when the application quits.
+ */
+class INCIDENCEEDITOR_TESTS_EXPORT FreeBusyCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum FetchPriority {
+        HighFetchPriority, //!< e.g. for the mandatory attendees
+        LowFetchPriority,
+    };
+
+    static FreeBusyCache *self();
+
+    /**
+     * Returns a free/busy item for @p attendee for a FreeBusyItemModel. It carries the
+     * cached free/busy info if there is one. Otherwise a fetch is requested and the item
+     * carries the last known info, if any.
+     *
+     * The item is marked as downloading while its free/busy info is being fetched by the
+     * cache, or if it is created with fresh info, so adding it to the model doesn't fetch it a
+     * second time. The mark is removed once the cache sets the fetched info on the item.
+     * The info is fetched again when it expires. If a fetch fails or times out the mark is
+     * removed as well, so the model fetches the item itself on its next reload.
+     */
+    [[nodiscard]] CalendarSupport::FreeBusyItem::Ptr
+    createItem(const KCalendarCore::Attendee &attendee, QWidget *parentWidget, FetchPriority priority = HighFetchPriority);
+
+    /**
+     * Returns the cached free/busy info of @p email, or a null pointer if there
+     * is none or it is older than timeToLive().
+     */
+    [[nodiscard]] KCalendarCore::FreeBusy::Ptr lookup(const QString &email) const;
+
+    /**
+     * Returns the last known free/busy info of @p email, however old it is, from the
+     * cache or from the snapshot file. Returns a null pointer if there is none.
+     */
+    [[nodiscard]] KCalendarCore::FreeBusy::Ptr lastKnown(const QString &email) const;
+
+    /**
+     * Caches @p freeBusy for @p email, e.g. when it was fetched elsewhere, and sets it on
+     * the items created for @p email. A running fetch for @p email counts as done.
+     * @param fetched the time of the fetch, now if invalid
+     */
+    void insert(const QString &email, const KCalendarCore::FreeBusy::Ptr &freeBusy, const QDateTime &fetched = {});
+
+    /**
+     * Fetches the free/busy info of @p email, unless it is cached or already being fetched.
+     * The fetch is queued if too many fetches are running. Requesting a queued email with
+     * a higher priority moves it forward.
+     */
+    void request(const QString &email, QWidget *parentWidget = nullptr, FetchPriority priority = HighFetchPriority);
+
+    /**
+     * Returns whether the free/busy info of @p email is being fetched or is queued.
+     */
+    [[nodiscard]] bool isFetching(const QString &email) const;
+
+    /**
+     * The number of fetches running at a time, at most two of them per host. Default is 4.
+     */
+    void setMaximumFetches(int count);
+    [[nodiscard]] int maximumFetches() const;
+
+    /**
+     * Replaces Akonadi::FreeBusyManager::retrieveFreeBusy() for starting a fetch, for tests.
+     * The fetcher returns false if the fetch couldn't be started. The result is passed to insert().
+     * An empty fetcher restores the default one.
+     */
+    void setFetcher(const std::function<bool(const QString &email, QWidget *parentWidget)> &fetcher);
+
+    /**
+     * Drops the cached free/busy info of @p email, the next request() fetches it again.
+     */
+    void invalidate(const QString &email);
+
+    /**
+     * Drops all cached free/busy info. The snapshot file is kept, until it is saved again.
+     */
+    void clear();
+
+    /**
+     * Uses @p fileName as snapshot file and maps it. The default is freebusy.snapshot
+     * in the cache directory of the library.
+     */
+    void setSnapshotFile(const QString &fileName);
+    [[nodiscard]] QString snapshotFile() const;
+
+    /**
+     * Writes the cache to the snapshot file, merged with the blocks another process
+     * saved in the meantime. This is done automatically shortly after new free/busy
+     * info was cached. If the snapshot is disabled, the file is removed instead.
+     */
+    bool saveSnapshot();
+
+    /**
+     * How long a cached free/busy info is used, in seconds. Default is 5 minutes.
+     */
+    void setTimeToLive(int seconds);
+    [[nodiscard]] int timeToLive() const;
+
+Q_SIGNALS:
+    /**
+     * Emitted when @p freeBusy was set on the items created for @p email, once for each
+     * letter case of the items whose models didn't get it from the Akonadi::FreeBusyManager.
+     * Connect the models to it, see FreeBusyItemModel::slotInsertFreeBusy().
+     */
+    void freeBusyCached(const QString &email, const KCalendarCore::FreeBusy::Ptr &freeBusy);
+
+private:
+    INCIDENCEEDITOR_NO_EXPORT FreeBusyCache();
+    ~FreeBusyCache() override;
+
+    INCIDENCEEDITOR_NO_EXPORT void slotFreeBusyRetrieved(const KCalendarCore::FreeBusy::Ptr &freeBusy, const QString &email);
+    /**
+     * Does insert(), the models of the items for @p deliveredEmail already got the info.
+     */
+    INCIDENCEEDITOR_NO_EXPORT void
+    cacheFreeBusy(const QString &email, const KCalendarCore::FreeBusy::Ptr &freeBusy, const QDateTime &fetched, const QString &deliveredEmail);
+    INCIDENCEEDITOR_NO_EXPORT void startFetches();
+    INCIDENCEEDITOR_NO_EXPORT void fetchFailed(const QString &key);
+    INCIDENCEEDITOR_NO_EXPORT void updateItems(const QString &key);
+    INCIDENCEEDITOR_NO_EXPORT void scheduleExpiry();
+    INCIDENCEEDITOR_NO_EXPORT void refreshExpiredItems();
+    INCIDENCEEDITOR_NO_EXPORT void savePendingSnapshot();
+    INCIDENCEEDITOR_NO_EXPORT void mapSnapshot();
+    INCIDENCEEDITOR_NO_EXPORT void unmapSnapshot();
+
+    struct Entry {
+        KCalendarCore::FreeBusy::Ptr freeBusy;
+        qint64 fetched = 0; //!< msecs since epoch
+    };
+    struct SnapshotBlock {
+        qint64 fetched = 0; //!< msecs since epoch
+        const qint64 *intervals = nullptr; //!< start and end of each interval, into the mapped file
+        quint32 count = 0;
+    };
+    [[nodiscard]] INCIDENCEEDITOR_NO_EXPORT static KCalendarCore::FreeBusy::Ptr freeBusyFromBlock(const SnapshotBlock &block);
+
+    struct HandedOutItem {
+        QWeakPointer<CalendarSupport::FreeBusyItem> item;
+        QPointer<QWidget> parentWidget;
+    };
+
+    struct QueuedFetch {
+        QString key;
+        QString email;
+        QPointer<QWidget> parentWidget;
+        FetchPriority priority;
+    };
+
+    QHash<QString, Entry> mEntries; //!< keyed by the lower case email
+    QHash<QString, QDeadlineTimer> mFetches; //!< running fetches, a fetch without answer expires
+    QList<QueuedFetch> mQueuedFetches; //!< ordered by priority, then by request
+    int mMaximumFetches;
+    QTimer mFetchTimeoutTimer;
+    std::function<bool(const QString &, QWidget *)> mFetcher;
+    int mTimeToLive;
+    QMultiHash<QString, HandedOutItem> mItems; //!< the items returned by createItem(), keyed by the lower case email
+    QTimer mExpiryTimer; //!< fires when the free/busy info of an item expires
+    qint64 mExpiredBefore; //!< msecs since epoch, the items whose info expired before were refreshed
+
+    QFile mSnapshotFile;
+    uchar *mSnapshotData = nullptr;
+    QHash<QString, SnapshotBlock> mSnapshotBlocks; //!< keyed by the lower case email
+    QSet<QString> mDroppedBlocks; //!< invalidated since the last save, by lower case email
+    QTimer mSaveTimer;
+    static FreeBusyCache *mSelf;
+};
+}
@@ -98,10 +98,12 @@ IncidenceAttendee::IncidenceAttendee(QWidget *parent, IncidenceDateTime *dateTim
     mUi->mOrganizerLabel->setVisible(false);
 
     mConflictResolver = new ConflictResolver(parent, parent);
+    mConflictResolver->beginConstraintsUpdate();
     mConflictResolver->setEarliestDate(mDateTime->startDate());
     mConflictResolver->setEarliestTime(mDateTime->startTime());
     mConflictResolver->setLatestDate(mDateTime->endDate());
     mConflictResolver->setLatestTime(mDateTime->endTime());
+    mConflictResolver->endConstraintsUpdate();
 
     connect(mUi->mSelectButton, &QPushButton::clicked, this, &IncidenceAttendee::slotSelectAddresses);
     connect(mUi->mSolveButton, &QPushButton::clicked, this, &IncidenceAttendee::slotSolveConflictPressed);
@@ -112,10 +114,14 @@ IncidenceAttendee::IncidenceAttendee(QWidget *parent, IncidenceDateTime *dateTim
     connect(mUi->mOrganizerCombo, &QComboBox::currentIndexChanged, this, &IncidenceAttendee::checkDirtyStatus);
     connect(mUi->mOrganizerCombo, &QComboBox::currentIndexChanged, this, &IncidenceAttendee::slotUpdateCryptoPreferences);
 
-    connect(mDateTime, &IncidenceDateTime::startDateChanged, this, &IncidenceAttendee::slotEventDurationChanged);
-    connect(mDateTime, &IncidenceDateTime::endDateChanged, this, &IncidenceAttendee::slotEventDurationChanged);
-    connect(mDateTime, &IncidenceDateTime::startTimeChanged, this, &IncidenceAttendee::slotEventDurationChanged);
-    connect(mDateTime, &IncidenceDateTime::endTimeChanged, this, &IncidenceAttendee::slotEventDurationChanged);
+    // a burst of date and time changes, e.g. while holding an arrow key, updates the conflicts once
+    mEventDurationTimer.setSingleShot(true);
+    mEventDurationTimer.setInterval(0);
+    connect(&mEventDurationTimer, &QTimer::timeout, this, &IncidenceAttendee::slotEventDurationChanged);
+    connect(mDateTime, &IncidenceDateTime::startDateChanged, &mEventDurationTimer, qOverload<>(&QTimer::start));
+    connect(mDateTime, &IncidenceDateTime::endDateChanged, &mEventDurationTimer, qOverload<>(&QTimer::start));
+    connect(mDateTime, &IncidenceDateTime::startTimeChanged, &mEventDurationTimer, qOverload<>(&QTimer::start));
+    connect(mDateTime, &IncidenceDateTime::endTimeChanged, &mEventDurationTimer, qOverload<>(&QTimer::start));
 
     connect(mConflictResolver, &ConflictResolver::conflictsDetected, this, &IncidenceAttendee::slotUpdateConflictLabel);
 
@@ -490,16 +496,9 @@ void IncidenceEditorNG::IncidenceAttendee::slotSolveConflictPressed()
 void IncidenceAttendee::slotConflictResolverAttendeeChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
 {
     if (AttendeeTableModel::FullName <= bottomRight.column() && AttendeeTableModel::FullName >= topLeft.column()) {
-        for (int i = topLeft.row(); i <= bottomRight.row(); ++i) {
-            QModelIndex email = dataModel()->index(i, AttendeeTableModel::Email);
-            auto attendee = dataModel()->data(email, AttendeeTableModel::AttendeeRole).value<KCalendarCore::Attendee>();
-            if (mConflictResolver->containsAttendee(attendee)) {
-                mConflictResolver->removeAttendee(attendee);
-            }
-            if (!dataModel()->data(email).toString().isEmpty()) {
-                mConflictResolver->insertAttendee(attendee);
-            }
-        }
+        // the old email of the changed rows is unknown, the resolver compares all of them;
+        // an attendee whose email stays keeps its free/busy info
+        mConflictResolver->setAttendees(mDataModel->attendees());
     }
     checkDirtyStatus();
 }
@@ -528,13 +527,8 @@ void IncidenceAttendee::slotConflictResolverAttendeeRemoved(const QModelIndex &i
 
 void IncidenceAttendee::slotConflictResolverLayoutChanged()
 {
-    const KCalendarCore::Attendee::List attendees = mDataModel->attendees();
-    mConflictResolver->clearAttendees();
-    for (const KCalendarCore::Attendee &attendee : attendees) {
-        if (!attendee.email().isEmpty()) {
-            mConflictResolver->insertAttendee(attendee);
-        }
-    }
+    // only the attendees which were added or removed change, the others keep their free/busy info
+    mConflictResolver->setAttendees(mDataModel->attendees());
     checkDirtyStatus();
 }
 
@@ -544,15 +538,7 @@ void IncidenceAttendee::slotFreeBusyAdded(const QModelIndex &parent, int first,
     if (parent.isValid()) {
         return;
     }
-    QAbstractItemModel *model = mConflictResolver->model();
-    for (int i = first; i <= last; ++i) {
-        QModelIndex index = model->index(i, 0, parent);
-        const KCalendarCore::Attendee &attendee = model->data(index, CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>();
-        const KCalendarCore::FreeBusy::Ptr &fb = model->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
-        if (!attendee.isNull()) {
-            updateFBStatus(attendee, fb);
-        }
-    }
+    updateFBStatus(first, last);
 }
 
 void IncidenceAttendee::slotFreeBusyChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
@@ -561,59 +547,53 @@ void IncidenceAttendee::slotFreeBusyChanged(const QModelIndex &topLeft, const QM
     if (topLeft.parent().isValid()) {
         return;
     }
-    QAbstractItemModel *model = mConflictResolver->model();
-    for (int i = topLeft.row(); i <= bottomRight.row(); ++i) {
-        QModelIndex index = model->index(i, 0);
-        const KCalendarCore::Attendee &attendee = model->data(index, CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>();
-        const KCalendarCore::FreeBusy::Ptr &fb = model->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
-        if (!attendee.isNull()) {
-            updateFBStatus(attendee, fb);
-        }
-    }
+    updateFBStatus(topLeft.row(), bottomRight.row());
 }
 
 void IncidenceAttendee::updateFBStatus()
 {
+    updateFBStatus(0, mConflictResolver->model()->rowCount() - 1);
+}
+
+void IncidenceAttendee::updateFBStatus(int first, int last)
+{
+    const KCalendarCore::Attendee::List attendees = mDataModel->attendees();
+    if (first > last || attendees.isEmpty()) {
+        return;
+    }
+    // the rows of the attendees by email, built once for all free/busy rows;
+    // backwards, so the first row of an email wins
+    QHash<QString, int> attendeeRows;
+    attendeeRows.reserve(attendees.size());
+    for (int row = attendees.size() - 1; row >= 0; --row) {
+        if (!attendees.at(row).email().isEmpty()) {
+            attendeeRows.insert(attendees.at(row).email().toLower(), row);
+        }
+    }
+
+    const QDateTime startTime = mDateTime->currentStartDateTime();
+    const QDateTime endTime = mDateTime->currentEndDateTime();
     QAbstractItemModel *model = mConflictResolver->model();
-    for (int i = 0; i < model->rowCount(); ++i) {
-        QModelIndex index = model->index(i, 0);
-        const KCalendarCore::Attendee &attendee = model->data(index, CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>();
-        const KCalendarCore::FreeBusy::Ptr &fb = model->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>();
-        if (!attendee.isNull()) {
-            updateFBStatus(attendee, fb);
-        }
-    }
-}
-
-void IncidenceAttendee::updateFBStatus(const KCalendarCore::Attendee &attendee, const KCalendarCore::FreeBusy::Ptr &fb)
-{
-    KCalendarCore::Attendee::List attendees = mDataModel->attendees();
-    QDateTime startTime = mDateTime->currentStartDateTime();
-    QDateTime endTime = mDateTime->currentEndDateTime();
-    if (attendees.contains(attendee)) {
-        int row = dataModel()->attendees().indexOf(attendee);
-        QModelIndex attendeeIndex = dataModel()->index(row, AttendeeTableModel::Available);
-        if (fb) {
-            KCalendarCore::Period::List busyPeriods = fb->busyPeriods();
-            for (auto it = busyPeriods.begin(); it != busyPeriods.end(); ++it) {
-                // periods started before and lapping into the incidence (s < startTime && e >= startTime)
-                // periods starting in the time of incidence (s >= startTime && s <= endTime)
-                if (((*it).start() < startTime && (*it).end() > startTime) || ((*it).start() >= startTime && (*it).start() <= endTime)) {
-                    switch (attendee.status()) {
-                    case KCalendarCore::Attendee::Accepted:
-                        dataModel()->setData(attendeeIndex, AttendeeTableModel::Accepted);
-                        return;
-                    default:
-                        dataModel()->setData(attendeeIndex, AttendeeTableModel::Busy);
-                        return;
-                    }
-                }
-            }
-            dataModel()->setData(attendeeIndex, AttendeeTableModel::Free);
+    QHash<int, AttendeeTableModel::AvailableStatus> statuses;
+    for (int i = first; i <= last; ++i) {
+        const QModelIndex index = model->index(i, 0);
+        const auto attendee = model->data(index, CalendarSupport::FreeBusyItemModel::AttendeeRole).value<KCalendarCore::Attendee>();
+        const auto row = attendeeRows.constFind(attendee.email().toLower());
+        if (attendee.isNull() || row == attendeeRows.cend()) {
+            continue;
+        }
+        if (!model->data(index, CalendarSupport::FreeBusyItemModel::FreeBusyRole).value<KCalendarCore::FreeBusy::Ptr>()) {
+            statuses.insert(*row, AttendeeTableModel::Unknown);
+        } else if (!mConflictResolver->isBusy(i, startTime, endTime)) {
+            statuses.insert(*row, AttendeeTableModel::Free);
+        } else if (attendee.status() == KCalendarCore::Attendee::Accepted) {
+            statuses.insert(*row, AttendeeTableModel::Accepted);
         } else {
-            dataModel()->setData(attendeeIndex, AttendeeTableModel::Unknown);
+            statuses.insert(*row, AttendeeTableModel::Busy);
         }
     }
+    // a single dataChanged for the Available column
+    mDataModel->setAvailableStatuses(statuses);
 }
 
 void IncidenceAttendee::slotUpdateConflictLabel(int count)
@@ -753,8 +733,10 @@ void IncidenceAttendee::slotEventDurationChanged()
         return;
     }
 
+    mConflictResolver->beginConstraintsUpdate();
     mConflictResolver->setEarliestDateTime(start);
     mConflictResolver->setLatestDateTime(end);
+    mConflictResolver->endConstraintsUpdate();
     updateFBStatus();
 }
 
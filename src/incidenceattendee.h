@@ -11,6 +11,9 @@
 
 #include <KCalendarCore/FreeBusy>
 #include <KContacts/Addressee>
+
+#include <QTimer>
+
 namespace Ui
 {
 class EventOrTodoDesktop;
@@ -89,7 +92,7 @@ private Q_SLOTS:
     void slotFreeBusyAdded(const QModelIndex &index, int first, int last);
     void slotFreeBusyChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
     void updateFBStatus();
-    void updateFBStatus(const KCalendarCore::Attendee &attendee, const KCalendarCore::FreeBusy::Ptr &fb);
+    void updateFBStatus(int first, int last);
 
     void slotGroupSubstitutionAttendeeAdded(const QModelIndex &index, int first, int last);
     void slotGroupSubstitutionAttendeeRemoved(const QModelIndex &index, int first, int last);
@@ -128,6 +131,9 @@ private:
     IncidenceDateTime *mDateTime = nullptr;
     QString mOrganizer;
 
+    /** folds the date and time changes of an event loop turn into one update */
+    QTimer mEventDurationTimer;
+
     /** used dataModel to rely on*/
     AttendeeTableModel *mDataModel = nullptr;
     AttendeeLineEditDelegate *mAttendeeDelegate = nullptr;
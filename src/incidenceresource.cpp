@@ -142,11 +142,7 @@ void IncidenceResource::dialogOkPressed()
 {
     ResourceItem::Ptr item = resourceDialog->selectedItem();
     if (item) {
-        const QString name = QString::fromLatin1(item->ldapObject().value(QStringLiteral("cn")));
-        const QString email = QString::fromLatin1(item->ldapObject().value(QStringLiteral("mail")));
-        KCalendarCore::Attendee attendee(name, email);
-        attendee.setCuType(KCalendarCore::Attendee::Resource);
-        dataModel->insertAttendee(dataModel->rowCount(), attendee);
+        dataModel->insertAttendee(dataModel->rowCount(), item->attendee());
     }
 }
 
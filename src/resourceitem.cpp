@@ -119,6 +119,15 @@ const KLDAPCore::LdapObject &ResourceItem::ldapObject() const
     return mLdapObject;
 }
 
+KCalendarCore::Attendee ResourceItem::attendee() const
+{
+    const QString name = QString::fromLatin1(mLdapObject.value(QStringLiteral("cn")));
+    const QString email = QString::fromLatin1(mLdapObject.value(QStringLiteral("mail")));
+    KCalendarCore::Attendee attendee(name, email);
+    attendee.setCuType(KCalendarCore::Attendee::Resource);
+    return attendee;
+}
+
 void ResourceItem::startSearch()
 {
     mLdapClient.startQuery(QStringLiteral("objectclass=*"));
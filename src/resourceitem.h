@@ -11,6 +11,8 @@
 
 #include <KLDAPCore/LdapObject>
 
+#include <KCalendarCore/Attendee>
+
 #include <QList>
 #include <QSharedPointer>
 #include <QStringList>
@@ -66,6 +68,11 @@ public:
      */
     const KLDAPCore::LdapObject &ldapObject() const;
 
+    /* Returns the resource as attendee, with the cn and the mail of the ldapObject.
+     *
+     */
+    [[nodiscard]] KCalendarCore::Attendee attendee() const;
+
     /* Set the ldapObject, either directly via this function
      * or use startSearch to request the ldapServer for the ldapObject
      * with the dn specified via the constructor.
@@ -5,6 +5,7 @@
  */
 
 #include "resourcemanagement.h"
+#include "freebusycache.h"
 #include "ldaputils.h"
 #include "resourcemodel.h"
 #include "ui_resourcemanagement.h"
@@ -114,6 +115,7 @@ ResourceManagement::ResourceManagement(QWidget *parent)
 
     mModel = new CalendarSupport::FreeBusyItemModel(this);
     mFreebusyCalendar.setModel(mModel);
+    connect(FreeBusyCache::self(), &FreeBusyCache::freeBusyCached, mModel, &CalendarSupport::FreeBusyItemModel::slotInsertFreeBusy);
 
     mAgendaView = new EventViews::AgendaView(QDate(), QDate(), false, false);
 
@@ -218,9 +220,8 @@ void ResourceManagement::showDetails(const KLDAPCore::LdapObject &obj, const KLD
     QString name = QString::fromUtf8(obj.attributes().value(QStringLiteral("cn"))[0]);
     QString email = QString::fromUtf8(obj.attributes().value(QStringLiteral("mail"))[0]);
     KCalendarCore::Attendee attendee(name, email);
-    CalendarSupport::FreeBusyItem::Ptr freebusy(new CalendarSupport::FreeBusyItem(attendee, this));
     mModel->clear();
-    mModel->addItem(freebusy);
+    mModel->addItem(FreeBusyCache::self()->createItem(attendee, this));
 }
 
 void ResourceManagement::slotLayoutChanged()
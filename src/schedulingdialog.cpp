@@ -20,6 +20,8 @@
 
 using namespace IncidenceEditorNG;
 
+static const int FIRST_SUGGESTIONS = 10; // shown as soon as they are known, before the search is done
+
 SchedulingDialog::SchedulingDialog(QDate startDate, QTime startTime, int duration, ConflictResolver *resolver, QWidget *parent)
     : QDialog(parent)
     , mResolver(resolver)
@@ -38,6 +40,9 @@ SchedulingDialog::SchedulingDialog(QDate startDate, QTime startTime, int duratio
 
     mainLayout->addWidget(w);
     mainLayout->addWidget(buttonBox);
+
+    // apply the initial constraints at once, instead of counting the conflicts after each of them
+    mResolver->beginConstraintsUpdate();
     fillCombos();
 
     Q_ASSERT(duration > 0);
@@ -60,6 +65,8 @@ SchedulingDialog::SchedulingDialog(QDate startDate, QTime startTime, int duratio
     connect(mWeekdayCombo, &IncidenceEditorNG::KWeekdayCheckCombo::checkedItemsChanged, this, &SchedulingDialog::slotMandatoryRolesChanged);
 
     connect(mResolver, &ConflictResolver::freeSlotsAvailable, mPeriodModel, &CalendarSupport::FreePeriodModel::slotNewFreePeriods);
+    connect(mResolver, &ConflictResolver::freeSlotsFound, this, &SchedulingDialog::slotFreeSlotsFound);
+    mResolver->setProgressiveBatchSize(FIRST_SUGGESTIONS);
     connect(mMoveBeginTimeEdit, &KTimeComboBox::timeEdited, this, &SchedulingDialog::slotSetEndTimeLabel);
 
     mTableView->setModel(mPeriodModel);
@@ -74,11 +81,16 @@ SchedulingDialog::SchedulingDialog(QDate startDate, QTime startTime, int duratio
     mResolver->setEarliestTime(mStartTime->time());
     mResolver->setLatestDate(mEndDate->date());
     mResolver->setLatestTime(mEndTime->time());
+    mResolver->endConstraintsUpdate();
 
     mMoveApptGroupBox->hide();
 }
 
-SchedulingDialog::~SchedulingDialog() = default;
+SchedulingDialog::~SchedulingDialog()
+{
+    // the resolver belongs to the attendee editor, which doesn't need the progressive results
+    mResolver->setProgressiveBatchSize(0);
+}
 
 void SchedulingDialog::slotUpdateIncidenceStartEnd(const QDateTime &startDateTime, const QDateTime &endDateTime)
 {
@@ -121,6 +133,16 @@ void SchedulingDialog::slotStartDateChanged(const QDate &newDate)
     }
 }
 
+void SchedulingDialog::slotFreeSlotsFound(const KCalendarCore::Period::List &slots, bool first)
+{
+    if (first) {
+        mFoundSlots = slots;
+    } else {
+        mFoundSlots << slots;
+    }
+    mPeriodModel->slotNewFreePeriods(mFoundSlots);
+}
+
 void SchedulingDialog::updateWeekDays(const QDate &oldDate)
 {
     const int oldStartDayIndex = mWeekdayCombo->weekdayIndex(oldDate);
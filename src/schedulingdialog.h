@@ -9,6 +9,8 @@
 
 #include "ui_schedulingdialog.h"
 
+#include <KCalendarCore/Period>
+
 #include <QDateTime>
 #include <QDialog>
 
@@ -45,6 +47,7 @@ private:
     void slotWeekdaysChanged();
     void slotMandatoryRolesChanged();
     void slotStartDateChanged(const QDate &newDate);
+    void slotFreeSlotsFound(const KCalendarCore::Period::List &slots, bool first);
 
     void slotRowSelectionChanged(const QModelIndex &current, const QModelIndex &previous);
     void slotSetEndTimeLabel(const QTime &startTime);
@@ -58,6 +61,7 @@ private:
 
     ConflictResolver *const mResolver;
     CalendarSupport::FreePeriodModel *const mPeriodModel;
+    KCalendarCore::Period::List mFoundSlots; //!< the free slots the current search reported so far
     VisualFreeBusyWidget *mVisualWidget = nullptr;
 };
 }